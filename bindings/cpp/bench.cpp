@@ -0,0 +1,463 @@
+/*
+ * 2008+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Self-contained benchmark: servers are started in this process with backend
+ * which answers every request from memory, so numbers do not depend on storage
+ * and can be reproduced on any box which builds elliptics.
+ */
+
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <elliptics/cppdef.h>
+
+using namespace ioremap::elliptics;
+
+/* library internals, see bench_internal.c */
+extern "C" {
+void dnet_bench_route(int num);
+void dnet_bench_join(void);
+void dnet_bench_trans(int num);
+}
+
+struct bench_options {
+	int			num;
+	int			clients;
+	int			port;
+	long			delay;
+	unsigned int		size;
+	std::vector<int>	io_threads;
+};
+
+struct bench_server {
+	struct dnet_node		*n;
+	struct dnet_backend_callbacks	cb;
+	char				dir[64];
+
+	/* every request is delayed by @delay usecs, reads return @size bytes */
+	long				delay;
+	unsigned int			size;
+};
+
+static double bench_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int bench_handler(void *state, void *priv, struct dnet_cmd *cmd, void *data)
+{
+	struct bench_server *s = (struct bench_server *)priv;
+
+	if (s->delay)
+		usleep(s->delay);
+
+	if (cmd->cmd == DNET_CMD_READ) {
+		std::vector<char> reply(sizeof(struct dnet_io_attr) + s->size, 'b');
+		struct dnet_io_attr *io = (struct dnet_io_attr *)&reply[0];
+
+		memcpy(io, data, sizeof(struct dnet_io_attr));
+		dnet_convert_io_attr(io);
+
+		io->offset = 0;
+		io->size = s->size;
+
+		dnet_convert_io_attr(io);
+		return dnet_send_reply(state, cmd, io, reply.size(), 0);
+	}
+
+	return -ENOTSUP;
+}
+
+static long long bench_meta_total(void *)
+{
+	return 0;
+}
+
+static ssize_t bench_meta_read(void *, struct dnet_raw_id *, void **)
+{
+	return -ENOENT;
+}
+
+static int bench_meta_write(void *, struct dnet_raw_id *, void *, size_t)
+{
+	return 0;
+}
+
+static int bench_meta_remove(void *, struct dnet_raw_id *, int)
+{
+	return 0;
+}
+
+static int bench_send(void *, void *, struct dnet_id *)
+{
+	return -ENOENT;
+}
+
+/*
+ * @cfg carries thread numbers and flags of the server, the rest is filled here.
+ */
+static int bench_server_start(struct bench_server *s, logger &l, struct dnet_config &cfg, int group_id, int port)
+{
+	memset(&s->cb, 0, sizeof(s->cb));
+	s->cb.command_handler = bench_handler;
+	s->cb.command_private = s;
+	s->cb.send = bench_send;
+	s->cb.meta_read = bench_meta_read;
+	s->cb.meta_write = bench_meta_write;
+	s->cb.meta_remove = bench_meta_remove;
+	s->cb.meta_total_elements = bench_meta_total;
+
+	snprintf(s->dir, sizeof(s->dir), "/tmp/dnet-bench-XXXXXX");
+	if (!mkdtemp(s->dir))
+		return -errno;
+
+	cfg.sock_type = SOCK_STREAM;
+	cfg.proto = IPPROTO_TCP;
+	cfg.family = AF_INET;
+	cfg.wait_timeout = 60;
+	cfg.check_timeout = 60;
+	cfg.flags |= DNET_CFG_JOIN_NETWORK | DNET_CFG_NO_META;
+	cfg.group_id = group_id;
+	cfg.log = l.get_dnet_log();
+	cfg.cb = &s->cb;
+
+	snprintf(cfg.addr, sizeof(cfg.addr), "127.0.0.1");
+	snprintf(cfg.port, sizeof(cfg.port), "%d", port);
+	snprintf(cfg.history_env, sizeof(cfg.history_env), "%s", s->dir);
+
+	s->n = dnet_server_node_create(&cfg);
+	if (!s->n) {
+		rmdir(s->dir);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void bench_server_stop(struct bench_server *s)
+{
+	std::string ids = std::string(s->dir) + "/ids";
+
+	dnet_server_node_destroy(s->n);
+
+	unlink(ids.c_str());
+	rmdir(s->dir);
+}
+
+struct bench_reader {
+	node		*n;
+	int		group_id;
+	int		index, num;
+	int		errors;
+};
+
+static void *bench_read_thread(void *priv)
+{
+	struct bench_reader *r = (struct bench_reader *)priv;
+
+	for (int i = 0; i < r->num; ++i) {
+		std::ostringstream key;
+		struct dnet_id id;
+
+		key << "bench-" << r->index << "-" << i;
+		r->n->transform(key.str(), id);
+		id.group_id = r->group_id;
+		id.type = 0;
+
+		try {
+			r->n->read_data_wait(id, 0, 0, 0, 0);
+		} catch (const std::exception &e) {
+			r->errors++;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Runs @o.num reads of group @group_id split between @o.clients threads,
+ * returns number of failed reads.
+ */
+static int bench_read(node &n, struct bench_options &o, int group_id)
+{
+	std::vector<struct bench_reader> readers(o.clients);
+	std::vector<pthread_t> tids(o.clients);
+	int i, errors = 0;
+
+	for (i = 0; i < o.clients; ++i) {
+		readers[i].n = &n;
+		readers[i].group_id = group_id;
+		readers[i].index = i;
+		readers[i].num = o.num / o.clients;
+		readers[i].errors = 0;
+
+		pthread_create(&tids[i], NULL, bench_read_thread, &readers[i]);
+	}
+
+	for (i = 0; i < o.clients; ++i) {
+		pthread_join(tids[i], NULL);
+		errors += readers[i].errors;
+	}
+
+	return errors;
+}
+
+/*
+ * Requests per second served by single server with different number of IO threads,
+ * every thread number is run with per-thread queues and with single shared queue
+ * which IO pool used before, so both dispatch schemes are measured by the same harness.
+ */
+static void bench_pool(logger &l, struct bench_options &o)
+{
+	static const struct {
+		const char	*name;
+		int		flags;
+	} queues[] = {
+		{"per-thread", 0},
+		{"shared", DNET_CFG_IO_SHARED_QUEUE},
+	};
+	static const size_t queue_num = sizeof(queues) / sizeof(queues[0]);
+
+	for (size_t k = 0; k < o.io_threads.size() * queue_num; ++k) {
+		struct bench_server s;
+		struct dnet_config cfg;
+		int err;
+
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.io_thread_num = o.io_threads[k / queue_num];
+		cfg.nonblocking_io_thread_num = o.io_threads[k / queue_num];
+		cfg.net_thread_num = 4;
+		cfg.flags = queues[k % queue_num].flags;
+
+		s.delay = o.delay;
+		s.size = o.size;
+
+		err = bench_server_start(&s, l, cfg, 1, o.port + k);
+		if (err) {
+			std::cerr << "pool: could not start server: " << err << std::endl;
+			return;
+		}
+
+		{
+			struct dnet_config ccfg;
+			std::vector<int> groups(1, 1);
+
+			memset(&ccfg, 0, sizeof(ccfg));
+			ccfg.wait_timeout = 60;
+			ccfg.check_timeout = 60;
+			ccfg.io_thread_num = 4;
+			ccfg.nonblocking_io_thread_num = 4;
+			ccfg.net_thread_num = 4;
+
+			node n(l, ccfg);
+			n.add_groups(groups);
+			n.add_remote("127.0.0.1", o.port + k, AF_INET);
+
+			double start = bench_now();
+			int errors = bench_read(n, o, 1);
+			double time = bench_now() - start;
+
+			std::cout << "pool: io threads: " << o.io_threads[k / queue_num]
+				<< ", queue: " << queues[k % queue_num].name << ", requests: " << o.num
+				<< ", errors: " << errors << ", time: " << time << " s"
+				<< ", rps: " << (long)(o.num / time) << std::endl;
+		}
+
+		bench_server_stop(&s);
+	}
+}
+
+/*
+ * Requests per second served by single server with epoll and io_uring network engines.
+ */
+static void bench_engine(logger &l, struct bench_options &o)
+{
+	static const struct {
+		const char	*name;
+		int		flags;
+	} engines[] = {
+		{"epoll", 0},
+		{"io_uring", DNET_CFG_IO_URING},
+	};
+
+	for (size_t k = 0; k < sizeof(engines) / sizeof(engines[0]); ++k) {
+		struct bench_server s;
+		struct dnet_config cfg;
+		int err;
+
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.io_thread_num = o.io_threads.back();
+		cfg.nonblocking_io_thread_num = o.io_threads.back();
+		cfg.net_thread_num = 4;
+		cfg.flags = engines[k].flags;
+
+		s.delay = o.delay;
+		s.size = o.size;
+
+		err = bench_server_start(&s, l, cfg, 1, o.port + k);
+		if (err) {
+			std::cerr << "engine: could not start server: " << err << std::endl;
+			return;
+		}
+
+		{
+			struct dnet_config ccfg;
+			std::vector<int> groups(1, 1);
+
+			memset(&ccfg, 0, sizeof(ccfg));
+			ccfg.wait_timeout = 60;
+			ccfg.check_timeout = 60;
+			ccfg.io_thread_num = 4;
+			ccfg.nonblocking_io_thread_num = 4;
+			ccfg.net_thread_num = 4;
+			ccfg.flags = engines[k].flags;
+
+			node n(l, ccfg);
+			n.add_groups(groups);
+			n.add_remote("127.0.0.1", o.port + k, AF_INET);
+
+			double start = bench_now();
+			int errors = bench_read(n, o, 1);
+			double time = bench_now() - start;
+
+			std::cout << "engine: " << engines[k].name << ", requests: " << o.num
+				<< ", errors: " << errors << ", time: " << time << " s"
+				<< ", rps: " << (long)(o.num / time) << std::endl;
+		}
+
+		bench_server_stop(&s);
+	}
+}
+
+static void parse_list(const char *str, std::vector<int> &list)
+{
+	std::istringstream in(str);
+	std::string item;
+
+	list.clear();
+	while (std::getline(in, item, ','))
+		list.push_back(atoi(item.c_str()));
+}
+
+static void usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options> test...\n"
+			"  tests:\n"
+			"    pool               - requests per second served with different number of IO threads,\n"
+			"                         with per-thread queues and with single shared queue\n"
+			"    engine             - requests per second served with epoll and io_uring network engines,\n"
+			"                         server uses the last number of IO threads given with -i\n"
+			"    route              - time of route lookup in groups of different size,\n"
+			"                         binary search of sorted ids and snapshot search index\n"
+			"    join               - time to add and remove ids of every node of 200-node group,\n"
+			"                         resorting the whole group and merging sorted ids\n"
+			"    trans              - time to match reply to one of 1000 and 100000 in-flight transactions\n"
+			"                         and send new one, in rbtree and hash table\n"
+			"  options:\n"
+			"  -n num               - number of requests (default: 100000)\n"
+			"  -c num               - number of client threads (default: 32)\n"
+			"  -i list              - comma separated numbers of server IO threads (default: 1,2,4,8,16,32,64)\n"
+			"  -d usecs             - server handles every request for given time (default: 0)\n"
+			"  -s size              - size of read reply (default: 100)\n"
+			"  -p port              - first port servers listen on (default: 1030)\n"
+			"  -l level             - log level (default: error)\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options o;
+	int ch, log_level = DNET_LOG_ERROR;
+
+	o.num = 100000;
+	o.clients = 32;
+	o.port = 1030;
+	o.delay = 0;
+	o.size = 100;
+	parse_list("1,2,4,8,16,32,64", o.io_threads);
+
+	while ((ch = getopt(argc, argv, "n:c:i:d:s:p:l:h")) != -1) {
+		switch (ch) {
+			case 'n':
+				o.num = atoi(optarg);
+				break;
+			case 'c':
+				o.clients = atoi(optarg);
+				break;
+			case 'i':
+				parse_list(optarg, o.io_threads);
+				break;
+			case 'd':
+				o.delay = atol(optarg);
+				break;
+			case 's':
+				o.size = atoi(optarg);
+				break;
+			case 'p':
+				o.port = atoi(optarg);
+				break;
+			case 'l':
+				log_level = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (optind == argc || o.clients <= 0 || o.io_threads.empty())
+		usage(argv[0]);
+
+	try {
+		log_file log("/dev/stderr", log_level);
+
+		for (int i = optind; i < argc; ++i) {
+			std::string test = argv[i];
+
+			if (test == "pool")
+				bench_pool(log, o);
+			else if (test == "engine")
+				bench_engine(log, o);
+			else if (test == "route")
+				dnet_bench_route(o.num);
+			else if (test == "join")
+				dnet_bench_join();
+			else if (test == "trans")
+				dnet_bench_trans(o.num);
+			else
+				usage(argv[0]);
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Error occured : " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,492 @@
+/*
+ * 2008+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Benchmarks of library internal structures for dnet_cpp_bench. Every case runs
+ * library code against the implementation it replaced, which is kept here only
+ * for comparison, on the same data.
+ */
+
+#include <sys/time.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../library/elliptics.h"
+
+#include "elliptics/packet.h"
+#include "elliptics/interface.h"
+
+static double dnet_bench_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void dnet_bench_random_id(unsigned char *id)
+{
+	int i;
+
+	for (i = 0; i < DNET_ID_SIZE; ++i)
+		id[i] = rand();
+}
+
+static int dnet_bench_id_compare(const void *k1, const void *k2)
+{
+	const struct dnet_state_id *id1 = k1;
+	const struct dnet_state_id *id2 = k2;
+
+	return dnet_id_cmp_str(id1->raw.id, id2->raw.id);
+}
+
+/*
+ * Route lookup used to binary search sorted group ids comparing them byte by byte,
+ * locked route table still does that when there is no snapshot.
+ */
+static int dnet_bench_route_bsearch(struct dnet_state_id *ids, int id_num, struct dnet_id *id)
+{
+	int low, high, i, cmp;
+
+	for (low = -1, high = id_num; high-low > 1; ) {
+		i = low + (high - low)/2;
+
+		cmp = dnet_id_cmp_str(ids[i].raw.id, id->id);
+		if (cmp < 0)
+			low = i;
+		else if (cmp > 0)
+			high = i;
+		else
+			goto out;
+	}
+	i = high - 1;
+
+out:
+	if (i == -1)
+		i = id_num - 1;
+
+	return i;
+}
+
+static void dnet_bench_route_group(int id_num, int num)
+{
+	struct dnet_state_id *ids;
+	struct dnet_route_group g;
+	struct dnet_id *keys;
+	int *old_pos, *new_pos;
+	double start, old_time, new_time;
+	int i, mismatch = 0;
+
+	ids = calloc(id_num, sizeof(struct dnet_state_id));
+	keys = calloc(num, sizeof(struct dnet_id));
+	old_pos = malloc(num * sizeof(int));
+	new_pos = malloc(num * sizeof(int));
+
+	memset(&g, 0, sizeof(g));
+	g.group_id = 1;
+	g.id_num = id_num;
+	g.ids = malloc(id_num * sizeof(struct dnet_route_id));
+	g.prefix = malloc((id_num + 1) * sizeof(uint64_t));
+	g.pos = malloc((id_num + 1) * sizeof(int));
+
+	if (!ids || !keys || !old_pos || !new_pos || !g.ids || !g.prefix || !g.pos) {
+		fprintf(stderr, "route: could not allocate %d ids\n", id_num);
+		goto out;
+	}
+
+	for (i = 0; i < id_num; ++i)
+		dnet_bench_random_id(ids[i].raw.id);
+	qsort(ids, id_num, sizeof(struct dnet_state_id), dnet_bench_id_compare);
+
+	/* the same way dnet_route_update_nolock() fills snapshot group */
+	for (i = 0; i < id_num; ++i) {
+		g.ids[i].raw = ids[i].raw;
+		g.ids[i].st = NULL;
+	}
+	dnet_route_index_build(&g, ids, 0, 1);
+
+	for (i = 0; i < num; ++i) {
+		dnet_bench_random_id(keys[i].id);
+		keys[i].group_id = 1;
+	}
+
+	start = dnet_bench_now();
+	for (i = 0; i < num; ++i)
+		old_pos[i] = dnet_bench_route_bsearch(ids, id_num, &keys[i]);
+	old_time = dnet_bench_now() - start;
+
+	start = dnet_bench_now();
+	for (i = 0; i < num; ++i)
+		new_pos[i] = dnet_route_id_search(&g, &keys[i]);
+	new_time = dnet_bench_now() - start;
+
+	for (i = 0; i < num; ++i)
+		mismatch += (old_pos[i] != new_pos[i]);
+
+	printf("route: ids: %d, lookups: %d, binary search: %.1f ns, index: %.1f ns, mismatches: %d\n",
+			id_num, num, old_time * 1000000000 / num, new_time * 1000000000 / num, mismatch);
+
+out:
+	free(g.pos);
+	free(g.prefix);
+	free(g.ids);
+	free(new_pos);
+	free(old_pos);
+	free(keys);
+	free(ids);
+}
+
+/*
+ * Time per lookup of random id in groups of different size.
+ */
+void dnet_bench_route(int num)
+{
+	static const int id_nums[] = {100, 5000, 50000, 500000};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(id_nums); ++i)
+		dnet_bench_route_group(id_nums[i], num);
+}
+
+/*
+ * Group update on join used to append new ids which were not found by bsearch
+ * and sort the whole group again, everything under @n->state_lock.
+ */
+static int dnet_bench_join_qsort(struct dnet_group *g, struct dnet_idc *idc)
+{
+	int i, num = 0;
+
+	g->ids = realloc(g->ids, (g->id_num + idc->id_num) * sizeof(struct dnet_state_id));
+	if (!g->ids) {
+		g->id_num = 0;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < idc->id_num; ++i) {
+		if (!bsearch(&idc->ids[i], g->ids, g->id_num, sizeof(struct dnet_state_id), dnet_bench_id_compare)) {
+			memcpy(&g->ids[g->id_num + num], &idc->ids[i], sizeof(struct dnet_state_id));
+			num++;
+		}
+	}
+
+	g->id_num += num;
+	qsort(g->ids, g->id_num, sizeof(struct dnet_state_id), dnet_bench_id_compare);
+
+	return num;
+}
+
+/* and removal sorted the remaining ids again after compaction */
+static void dnet_bench_leave_qsort(struct dnet_group *g, struct dnet_net_state *st)
+{
+	int i, pos;
+
+	for (i = 0, pos = 0; i < g->id_num; ++i) {
+		if (g->ids[i].idc != st->idc) {
+			g->ids[pos] = g->ids[i];
+			pos++;
+		}
+	}
+
+	g->id_num = pos;
+	qsort(g->ids, g->id_num, sizeof(struct dnet_state_id), dnet_bench_id_compare);
+	st->idc = NULL;
+}
+
+/* dnet_idc_create() sorts a copy of new ids before it takes the lock */
+static int dnet_bench_join_merge(struct dnet_group *g, struct dnet_idc *idc, double *sort_time)
+{
+	struct dnet_state_id *sorted;
+	double start = dnet_bench_now();
+	int num;
+
+	sorted = malloc(idc->id_num * sizeof(struct dnet_state_id));
+	if (!sorted)
+		return -ENOMEM;
+
+	memcpy(sorted, idc->ids, idc->id_num * sizeof(struct dnet_state_id));
+	qsort(sorted, idc->id_num, sizeof(struct dnet_state_id), dnet_bench_id_compare);
+	*sort_time += dnet_bench_now() - start;
+
+	num = dnet_idc_merge_ids(g, sorted, idc->id_num);
+
+	free(sorted);
+	return num;
+}
+
+static void dnet_bench_join_group(int node_num, int id_num)
+{
+	struct dnet_group old_group, new_group;
+	struct dnet_net_state *states;
+	struct dnet_idc **idcs;
+	double start, old_join, new_join, sort_time = 0, old_leave, new_leave;
+	int i, j, err = 0, mismatch;
+
+	memset(&old_group, 0, sizeof(old_group));
+	memset(&new_group, 0, sizeof(new_group));
+
+	states = calloc(node_num, sizeof(struct dnet_net_state));
+	idcs = calloc(node_num, sizeof(struct dnet_idc *));
+	if (!states || !idcs)
+		goto err_out_free;
+
+	for (i = 0; i < node_num; ++i) {
+		struct dnet_idc *idc;
+
+		idc = calloc(1, sizeof(struct dnet_idc) + id_num * sizeof(struct dnet_state_id));
+		if (!idc)
+			goto err_out_free;
+
+		idc->st = &states[i];
+		idc->id_num = id_num;
+		for (j = 0; j < id_num; ++j) {
+			dnet_bench_random_id(idc->ids[j].raw.id);
+			idc->ids[j].idc = idc;
+		}
+
+		idcs[i] = idc;
+	}
+
+	start = dnet_bench_now();
+	for (i = 0; i < node_num && err >= 0; ++i)
+		err = dnet_bench_join_qsort(&old_group, idcs[i]);
+	old_join = dnet_bench_now() - start;
+
+	start = dnet_bench_now();
+	for (i = 0; i < node_num && err >= 0; ++i)
+		err = dnet_bench_join_merge(&new_group, idcs[i], &sort_time);
+	new_join = dnet_bench_now() - start;
+
+	if (err < 0)
+		goto err_out_free;
+
+	mismatch = (old_group.id_num != new_group.id_num) ||
+		memcmp(old_group.ids, new_group.ids, new_group.id_num * sizeof(struct dnet_state_id));
+
+	for (i = 0; i < node_num; ++i)
+		states[i].idc = idcs[i];
+
+	start = dnet_bench_now();
+	for (i = 0; i < node_num; ++i)
+		dnet_bench_leave_qsort(&old_group, &states[i]);
+	old_leave = dnet_bench_now() - start;
+
+	for (i = 0; i < node_num; ++i)
+		states[i].idc = idcs[i];
+
+	start = dnet_bench_now();
+	for (i = 0; i < node_num; ++i)
+		dnet_idc_remove_ids(&states[i], &new_group);
+	new_leave = dnet_bench_now() - start;
+
+	printf("join: nodes: %d, ids: %d, join: realloc+qsort: %.1f ms, merge: %.1f ms (%.1f ms of it sorting new ids out of lock), "
+			"leave: compaction+qsort: %.1f ms, compaction: %.1f ms, groups differ: %d\n",
+			node_num, id_num, old_join * 1000, new_join * 1000, sort_time * 1000,
+			old_leave * 1000, new_leave * 1000, mismatch);
+	goto out;
+
+err_out_free:
+	fprintf(stderr, "join: could not allocate %d nodes with %d ids\n", node_num, id_num);
+out:
+	for (i = 0; idcs && i < node_num; ++i)
+		free(idcs[i]);
+	free(idcs);
+	free(states);
+	free(new_group.ids);
+	free(old_group.ids);
+}
+
+/*
+ * Time to join and then leave the whole group, node by node, the way
+ * clients update their route tables when every server of the group restarts.
+ */
+void dnet_bench_join(void)
+{
+	static const int id_nums[] = {64, 256};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(id_nums); ++i)
+		dnet_bench_join_group(200, id_nums[i]);
+}
+
+/*
+ * Transactions used to be kept in per-state rbtree linked through node
+ * which was the first member of the transaction.
+ */
+struct dnet_bench_rb_trans {
+	struct rb_node		entry;
+	struct dnet_trans	t;
+};
+
+static struct dnet_bench_rb_trans *dnet_bench_rb_search(struct rb_root *root, uint64_t trans)
+{
+	struct rb_node *n = root->rb_node;
+	struct dnet_bench_rb_trans *t;
+
+	while (n) {
+		t = rb_entry(n, struct dnet_bench_rb_trans, entry);
+
+		if (t->t.trans > trans)
+			n = n->rb_left;
+		else if (t->t.trans < trans)
+			n = n->rb_right;
+		else {
+			dnet_trans_get(&t->t);
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+static int dnet_bench_rb_insert(struct rb_root *root, struct dnet_bench_rb_trans *a)
+{
+	struct rb_node **n = &root->rb_node, *parent = NULL;
+	struct dnet_bench_rb_trans *t;
+
+	while (*n) {
+		parent = *n;
+
+		t = rb_entry(parent, struct dnet_bench_rb_trans, entry);
+
+		if (t->t.trans > a->t.trans)
+			n = &parent->rb_left;
+		else if (t->t.trans < a->t.trans)
+			n = &parent->rb_right;
+		else
+			return -EEXIST;
+	}
+
+	rb_link_node(&a->entry, parent, n);
+	rb_insert_color(&a->entry, root);
+	return 0;
+}
+
+/*
+ * Every reply is matched to random in-flight transaction, which is removed,
+ * and new transaction is sent instead, so that @inflight transactions are always
+ * waiting for reply. Both tables are accessed under the lock like @st->trans_lock.
+ */
+static void dnet_bench_trans_table(int inflight, int num)
+{
+	struct dnet_bench_rb_trans *rb_trans;
+	struct dnet_trans *trans, *t;
+	struct dnet_trans_table table;
+	struct rb_root root = RB_ROOT;
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	double start, old_time, new_time;
+	uint64_t id = 0;
+	int *slots = NULL;
+	int i, err, lost = 0;
+
+	rb_trans = calloc(inflight, sizeof(struct dnet_bench_rb_trans));
+	trans = calloc(inflight, sizeof(struct dnet_trans));
+	slots = malloc(num * sizeof(int));
+	err = dnet_trans_table_init(&table, DNET_TRANS_TABLE_SIZE);
+	if (!rb_trans || !trans || !slots || err) {
+		fprintf(stderr, "trans: could not allocate %d transactions\n", inflight);
+		goto out;
+	}
+
+	for (i = 0; i < num; ++i)
+		slots[i] = rand() % inflight;
+
+	for (i = 0; i < inflight; ++i) {
+		rb_trans[i].t.trans = ++id;
+		atomic_init(&rb_trans[i].t.refcnt, 1);
+		dnet_bench_rb_insert(&root, &rb_trans[i]);
+
+		t = &trans[i];
+		t->trans = id;
+		atomic_init(&t->refcnt, 1);
+		INIT_LIST_HEAD(&t->trans_entry);
+		dnet_trans_insert_nolock(&table, t);
+	}
+
+	start = dnet_bench_now();
+	for (i = 0; i < num; ++i) {
+		struct dnet_bench_rb_trans *rt = &rb_trans[slots[i]];
+
+		pthread_mutex_lock(&lock);
+		rt = dnet_bench_rb_search(&root, rt->t.trans);
+		if (rt) {
+			rb_erase(&rt->entry, &root);
+			rt->entry.rb_parent_color = 0;
+		}
+		pthread_mutex_unlock(&lock);
+
+		if (!rt) {
+			lost++;
+			continue;
+		}
+		dnet_trans_put(&rt->t);
+
+		rt->t.trans = ++id;
+
+		pthread_mutex_lock(&lock);
+		dnet_bench_rb_insert(&root, rt);
+		pthread_mutex_unlock(&lock);
+	}
+	old_time = dnet_bench_now() - start;
+
+	/* the same ids are replied to and sent */
+	id = inflight;
+
+	start = dnet_bench_now();
+	for (i = 0; i < num; ++i) {
+		pthread_mutex_lock(&lock);
+		t = dnet_trans_search(&table, trans[slots[i]].trans);
+		if (t)
+			dnet_trans_remove_nolock(&table, t);
+		pthread_mutex_unlock(&lock);
+
+		if (!t) {
+			lost++;
+			continue;
+		}
+		dnet_trans_put(t);
+
+		t->trans = ++id;
+
+		pthread_mutex_lock(&lock);
+		dnet_trans_insert_nolock(&table, t);
+		pthread_mutex_unlock(&lock);
+	}
+	new_time = dnet_bench_now() - start;
+
+	printf("trans: in-flight: %d, replies: %d, rbtree: %.1f ns, hash table: %.1f ns, lost replies: %d\n",
+			inflight, num, old_time * 1000000000 / num, new_time * 1000000000 / num, lost);
+
+out:
+	dnet_trans_table_cleanup(&table);
+	free(slots);
+	free(trans);
+	free(rb_trans);
+}
+
+/*
+ * Time to match reply to its transaction and send new one instead
+ * with different number of in-flight transactions per state.
+ */
+void dnet_bench_trans(int num)
+{
+	static const int inflight[] = {1000, 100000};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(inflight); ++i)
+		dnet_bench_trans_table(inflight[i], num);
+}
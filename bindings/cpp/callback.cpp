@@ -21,8 +21,13 @@
 #include <sys/mman.h>
 #include <sys/wait.h>
 
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
 #include <sstream>
 #include <stdexcept>
+#include <vector>
 
 #include "elliptics/cppdef.h"
 
@@ -62,3 +67,290 @@ std::string callback::wait(int completed)
 
 	return data;
 }
+
+namespace ioremap { namespace elliptics {
+
+struct async_state {
+	pthread_mutex_t		lock;
+	pthread_cond_t		wait_cond;
+
+	/* every async_result copy holds a reference, transactions hold one more until completion */
+	int			refcnt;
+
+	struct dnet_node	*n;
+	int			cmd;
+	async_handler		*handler;
+
+	/* result is ready when submission is over and every sent transaction has been destroyed */
+	int			expected, completed;
+	bool			submitting, done;
+
+	/* request succeeds if at least one transaction has got successful reply */
+	bool			replied;
+	int			err;
+	std::string		data;
+
+	/* read tries groups one by one until object is found, write keeps its data alive while it is sent */
+	struct dnet_io_control	ctl;
+	std::vector<int>	groups;
+	size_t			group_pos;
+	std::string		payload;
+};
+
+}}; /* namespace ioremap::elliptics */
+
+static void async_state_put(struct async_state *s)
+{
+	pthread_mutex_lock(&s->lock);
+	int refcnt = --s->refcnt;
+	pthread_mutex_unlock(&s->lock);
+
+	if (!refcnt) {
+		pthread_cond_destroy(&s->wait_cond);
+		pthread_mutex_destroy(&s->lock);
+		delete s;
+	}
+}
+
+static void async_state_finish(struct async_state *s)
+{
+	pthread_mutex_lock(&s->lock);
+	if (s->replied)
+		s->err = 0;
+	s->done = true;
+	pthread_cond_broadcast(&s->wait_cond);
+	pthread_mutex_unlock(&s->lock);
+
+	/* nobody changes result once it is done */
+	if (s->handler)
+		s->handler->complete(s->err, s->data);
+
+	async_state_put(s);
+}
+
+/* called by submitter when @num transactions have been sent */
+static void async_state_sent(struct async_state *s, int num)
+{
+	bool finished;
+
+	pthread_mutex_lock(&s->lock);
+	s->expected += num;
+	s->submitting = false;
+	finished = (s->completed == s->expected);
+	pthread_mutex_unlock(&s->lock);
+
+	if (finished)
+		async_state_finish(s);
+}
+
+async_result::async_result(struct dnet_node *n, int cmd, async_handler *handler)
+{
+	m_state = new async_state;
+
+	pthread_mutex_init(&m_state->lock, NULL);
+	pthread_cond_init(&m_state->wait_cond, NULL);
+
+	/* one for this object, another one for transactions */
+	m_state->refcnt = 2;
+
+	m_state->n = n;
+	m_state->cmd = cmd;
+	m_state->handler = handler;
+
+	m_state->expected = 0;
+	m_state->completed = 0;
+	m_state->submitting = true;
+	m_state->done = false;
+
+	m_state->replied = false;
+	m_state->err = -ENOENT;
+
+	memset(&m_state->ctl, 0, sizeof(struct dnet_io_control));
+	m_state->group_pos = 0;
+}
+
+async_result::async_result(const async_result &other) : m_state(other.m_state)
+{
+	pthread_mutex_lock(&m_state->lock);
+	m_state->refcnt++;
+	pthread_mutex_unlock(&m_state->lock);
+}
+
+async_result &async_result::operator =(const async_result &other)
+{
+	if (m_state != other.m_state) {
+		pthread_mutex_lock(&other.m_state->lock);
+		other.m_state->refcnt++;
+		pthread_mutex_unlock(&other.m_state->lock);
+
+		async_state_put(m_state);
+		m_state = other.m_state;
+	}
+
+	return *this;
+}
+
+async_result::~async_result()
+{
+	async_state_put(m_state);
+}
+
+bool async_result::ready()
+{
+	pthread_mutex_lock(&m_state->lock);
+	bool done = m_state->done;
+	pthread_mutex_unlock(&m_state->lock);
+
+	return done;
+}
+
+int async_result::wait()
+{
+	pthread_mutex_lock(&m_state->lock);
+	while (!m_state->done)
+		pthread_cond_wait(&m_state->wait_cond, &m_state->lock);
+	int err = m_state->err;
+	pthread_mutex_unlock(&m_state->lock);
+
+	return err;
+}
+
+std::string async_result::get()
+{
+	int err = wait();
+	if (err) {
+		std::ostringstream str;
+		str << dnet_dump_id(&m_state->ctl.id) << ": " << dnet_cmd_string(m_state->cmd) <<
+			": err: " << strerror(-err) << ": " << err;
+		throw std::runtime_error(str.str());
+	}
+
+	return m_state->data;
+}
+
+void async_result::start_read(struct dnet_io_control &ctl, int *groups, int group_num)
+{
+	struct async_state *s = m_state;
+
+	s->ctl = ctl;
+	s->ctl.complete = async_result::complete_callback;
+	s->ctl.priv = s;
+	s->groups.assign(groups, groups + group_num);
+
+	if (s->groups.empty()) {
+		async_state_sent(s, 0);
+		return;
+	}
+
+	s->ctl.id.group_id = s->groups[s->group_pos++];
+	dnet_read_object(s->n, &s->ctl);
+	async_state_sent(s, 1);
+}
+
+void async_result::start_write(struct dnet_io_control &ctl, const std::string &data)
+{
+	struct async_state *s = m_state;
+
+	s->payload = data;
+
+	s->ctl = ctl;
+	s->ctl.data = s->payload.data();
+	s->ctl.complete = async_result::complete_callback;
+	s->ctl.priv = s;
+
+	int num = dnet_write_object(s->n, &s->ctl);
+	async_state_sent(s, num > 0 ? num : 0);
+}
+
+void async_result::start_lookup(struct dnet_id &id, uint64_t cflags)
+{
+	struct async_state *s = m_state;
+
+	s->ctl.id = id;
+
+	/* completion is called exactly once even if transaction was not sent */
+	dnet_lookup_object(s->n, &id, cflags, async_result::complete_callback, s);
+	async_state_sent(s, 1);
+}
+
+void async_result::start_remove(struct dnet_io_control &ctl)
+{
+	struct async_state *s = m_state;
+
+	s->ctl = ctl;
+	s->ctl.complete = async_result::complete_callback;
+	s->ctl.priv = s;
+
+	int num = dnet_trans_create_send_all(s->n, &s->ctl);
+	async_state_sent(s, num > 0 ? num : 0);
+}
+
+int async_result::complete_callback(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct async_state *s = reinterpret_cast<struct async_state *>(priv);
+
+	if (is_trans_destroyed(st, cmd)) {
+		bool retry = false, finished;
+
+		pthread_mutex_lock(&s->lock);
+		if (cmd && cmd->status && !s->replied)
+			s->err = cmd->status;
+
+		s->completed++;
+
+		/* object was not read, try next group */
+		if ((s->cmd == DNET_CMD_READ) && !s->replied && (s->group_pos < s->groups.size())) {
+			s->ctl.id.group_id = s->groups[s->group_pos++];
+			s->expected++;
+			retry = true;
+		}
+
+		finished = !s->submitting && (s->completed == s->expected);
+		pthread_mutex_unlock(&s->lock);
+
+		if (retry)
+			dnet_read_object(s->n, &s->ctl);
+		if (finished)
+			async_state_finish(s);
+		return 0;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	if (cmd->status) {
+		if (!s->replied)
+			s->err = cmd->status;
+		goto out_unlock;
+	}
+
+	switch (s->cmd) {
+	case DNET_CMD_READ:
+		if (!s->replied && (cmd->size >= sizeof(struct dnet_io_attr))) {
+			struct dnet_io_attr *io = (struct dnet_io_attr *)(cmd + 1);
+
+			dnet_convert_io_attr(io);
+			if (cmd->size >= sizeof(struct dnet_io_attr) + io->size) {
+				s->data.assign((const char *)(io + 1), io->size);
+				s->replied = true;
+			}
+		}
+		break;
+	case DNET_CMD_WRITE:
+		s->replied = true;
+		if (cmd->size <= sizeof(struct dnet_addr_attr) + sizeof(struct dnet_file_info))
+			break;
+		/* store reply just like lookup does */
+		/* fallthrough */
+	case DNET_CMD_LOOKUP:
+		s->replied = true;
+		s->data.append((const char *)dnet_state_addr(st), sizeof(struct dnet_addr));
+		s->data.append((const char *)cmd, sizeof(struct dnet_cmd) + cmd->size);
+		break;
+	default:
+		s->replied = true;
+		break;
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&s->lock);
+	return 0;
+}
@@ -20,6 +20,7 @@
 #include <sys/socket.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 
 #include <errno.h>
 #include <ctype.h>
@@ -39,6 +40,7 @@
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/unordered_set.hpp>
 #include <elliptics/cppdef.h>
 
 using namespace ioremap::elliptics;
@@ -462,7 +464,7 @@ std::string node::write_cache(const std::string &key, const std::string &str,
 }
 
 std::string node::write_data_wait(struct dnet_id &id, const std::string &str,
-		uint64_t remote_offset, uint64_t cflags, unsigned int ioflags)
+		uint64_t remote_offset, uint64_t cflags, unsigned int ioflags, int quorum)
 {
 	struct dnet_io_control ctl;
 
@@ -482,7 +484,7 @@ std::string node::write_data_wait(struct dnet_id &id, const std::string &str,
 	ctl.fd = -1;
 
 	char *result = NULL;
-	int err = dnet_write_data_wait(m_node, &ctl, (void **)&result);
+	int err = dnet_write_data_wait_quorum(m_node, &ctl, (void **)&result, quorum);
 	if (err < 0) {
 		std::ostringstream string;
 		string << dnet_dump_id(&id) << ": WRITE: size: " << str.size() << ", err: " << err;
@@ -496,7 +498,7 @@ std::string node::write_data_wait(struct dnet_id &id, const std::string &str,
 }
 
 std::string node::write_data_wait(const std::string &remote, const std::string &str,
-		uint64_t remote_offset, uint64_t cflags, unsigned int ioflags, int type)
+		uint64_t remote_offset, uint64_t cflags, unsigned int ioflags, int type, int quorum)
 {
 	struct dnet_id id;
 
@@ -504,7 +506,7 @@ std::string node::write_data_wait(const std::string &remote, const std::string &
 	id.type = type;
 	id.group_id = 0;
 
-	return write_data_wait(id, str, remote_offset, cflags, ioflags);
+	return write_data_wait(id, str, remote_offset, cflags, ioflags, quorum);
 }
 
 std::string node::lookup_addr(const std::string &remote, const int group_id)
@@ -1250,18 +1252,160 @@ void node::reply(const struct sph &orig_sph, const std::string &event, const std
 }
 
 namespace {
-	bool dnet_io_attr_compare(const struct dnet_io_attr &io1, const struct dnet_io_attr &io2) {
-		int cmp;
+	struct bulk_read_key {
+		unsigned char		id[DNET_ID_SIZE];
+
+		bool operator ==(const bulk_read_key &other) const {
+			return !memcmp(id, other.id, DNET_ID_SIZE);
+		}
+	};
+
+	/* ids are hashes already */
+	struct bulk_read_key_hash {
+		size_t operator ()(const bulk_read_key &key) const {
+			size_t hash;
+
+			memcpy(&hash, key.id, sizeof(hash));
+			return hash;
+		}
+	};
+
+	typedef boost::unordered_set<bulk_read_key, bulk_read_key_hash> bulk_read_set;
+
+	/*
+	 * Shared with transactions, which may outlive bulk_read() if some group did not reply in time,
+	 * so context is freed by whoever is the last: caller or destruction of the last transaction.
+	 */
+	struct bulk_read_context {
+		bulk_read_context() : sent(0), completed(0), status(0), calls(0), abandoned(false) {
+			pthread_mutex_init(&lock, NULL);
+			pthread_cond_init(&wait_cond, NULL);
+		}
+
+		~bulk_read_context() {
+			pthread_cond_destroy(&wait_cond);
+			pthread_mutex_destroy(&lock);
+		}
+
+		pthread_mutex_t		lock;
+		pthread_cond_t		wait_cond;
+
+		/* transactions sent to all groups and destroyed ones */
+		int			sent, completed;
+		/* the last error transaction was completed with, not found keys are not errors */
+		int			status;
+
+		/* handler calls in progress, handler is not called after caller has returned */
+		int			calls;
+		bool			abandoned;
+
+		/* keys not yet found, object is handed out only once even if several groups return it */
+		bulk_read_set		pending;
+		bulk_read_handler	*handler;
+
+		/* requests sent to every group, they have to live until transactions are completed */
+		std::list<std::vector<struct dnet_io_attr> >	ios;
+
+		std::string		error;
+	};
+
+	int bulk_read_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+	{
+		struct bulk_read_context *ctx = reinterpret_cast<struct bulk_read_context *>(priv);
+
+		int err = is_trans_destroyed(st, cmd);
+		if (err) {
+			pthread_mutex_lock(&ctx->lock);
+			if (err < 0 && err != -ENOENT)
+				ctx->status = err;
+			ctx->completed++;
+			bool last = ctx->abandoned && (ctx->completed == ctx->sent);
+			pthread_cond_broadcast(&ctx->wait_cond);
+			pthread_mutex_unlock(&ctx->lock);
+
+			if (last)
+				delete ctx;
+			return 0;
+		}
+
+		if (cmd->status || (cmd->size < sizeof(struct dnet_io_attr)))
+			return cmd->status;
+
+		struct dnet_io_attr *io = (struct dnet_io_attr *)(cmd + 1);
+		dnet_convert_io_attr(io);
+
+		if (cmd->size < sizeof(struct dnet_io_attr) + io->size)
+			return -EINVAL;
+
+		bulk_read_key key;
+		memcpy(key.id, io->id, DNET_ID_SIZE);
+
+		pthread_mutex_lock(&ctx->lock);
+		size_t found = 0;
+		if (!ctx->abandoned) {
+			found = ctx->pending.erase(key);
+			ctx->calls += found;
+		}
+		pthread_mutex_unlock(&ctx->lock);
+
+		if (!found)
+			return 0;
+
+		/* exception can not be thrown through C code, it is rethrown when all groups are done */
+		std::string error;
+		try {
+			ctx->handler->object(*io, (const char *)(io + 1));
+		} catch (const std::exception &e) {
+			error = e.what();
+		} catch (...) {
+			error = "unknown exception";
+		}
 
-		cmp = dnet_id_cmp_str(io1.id, io2.id);
-		return cmp < 0;
+		pthread_mutex_lock(&ctx->lock);
+		if (ctx->error.empty())
+			ctx->error = error;
+		if (!--ctx->calls)
+			pthread_cond_broadcast(&ctx->wait_cond);
+		pthread_mutex_unlock(&ctx->lock);
+
+		return 0;
 	}
+
+	/* collects objects in the format of the old bulk_read: id, 8 bytes of size, data */
+	class bulk_read_collector : public bulk_read_handler {
+		public:
+			bulk_read_collector() {
+				pthread_mutex_init(&lock, NULL);
+			}
+
+			~bulk_read_collector() {
+				pthread_mutex_destroy(&lock);
+			}
+
+			void object(const struct dnet_io_attr &io, const char *data) {
+				uint64_t size = dnet_bswap64(io.size);
+				std::string str;
+
+				str.reserve(DNET_ID_SIZE + 8 + io.size);
+				str.append((const char *)io.id, DNET_ID_SIZE);
+				str.append((const char *)&size, 8);
+				str.append(data, io.size);
+
+				pthread_mutex_lock(&lock);
+				ret.push_back(str);
+				pthread_mutex_unlock(&lock);
+			}
+
+			std::vector<std::string>	ret;
+
+		private:
+			pthread_mutex_t			lock;
+	};
 }
 
-std::vector<std::string> node::bulk_read(const std::vector<struct dnet_io_attr> &ios, uint64_t cflags)
+size_t node::bulk_read(const std::vector<struct dnet_io_attr> &ios, bulk_read_handler &handler, uint64_t cflags)
 {
-	struct dnet_range_data *data;
-	int num, *g, err;
+	int num, *g;
 
 	num = dnet_mix_states(m_node, NULL, &g);
 	if (num < 0)
@@ -1276,64 +1420,122 @@ std::vector<std::string> node::bulk_read(const std::vector<struct dnet_io_attr>
 		throw;
 	}
 
-	std::vector<struct dnet_io_attr> tmp_ios = ios;
-	std::sort(tmp_ios.begin(), tmp_ios.end(), dnet_io_attr_compare);
+	struct bulk_read_context *ctx = new bulk_read_context;
 
-	std::vector<std::string> ret;
+	ctx->handler = &handler;
 
-	for (std::vector<int>::iterator group = groups.begin(); group != groups.end(); ++group) {
-		if (!tmp_ios.size())
-			break;
+	/* groups which could not be asked or did not reply in time */
+	std::ostringstream failed;
+	bool oom = false;
+	int err = 0;
 
-		data = dnet_bulk_read(m_node, (struct dnet_io_attr *)(&tmp_ios[0]), tmp_ios.size(), *group, cflags, &err);
-		if (!data && err) {
-			std::ostringstream str;
-			str << "Failed to read bulk data: group: " << *group <<
-				": err: " << strerror(-err) << ": " << err;
-			throw std::runtime_error(str.str());
+	try {
+		ctx->pending.rehash(ios.size());
+
+		for (size_t i = 0; i < ios.size(); ++i) {
+			bulk_read_key key;
+
+			memcpy(key.id, ios[i].id, DNET_ID_SIZE);
+			ctx->pending.insert(key);
 		}
 
-		if (data) {
-			for (int i = 0; i < err; ++i) {
-				struct dnet_range_data *d = &data[i];
-				char *data = (char *)d->data;
+		for (std::vector<int>::iterator group = groups.begin(); group != groups.end(); ++group) {
+			std::vector<struct dnet_io_attr> tmp_ios;
 
-				while (d->size) {
-					struct dnet_io_attr *io = (struct dnet_io_attr *)data;
+			/* replies from groups which timed out may still arrive */
+			pthread_mutex_lock(&ctx->lock);
+			for (size_t i = 0; i < ios.size(); ++i) {
+				bulk_read_key key;
 
-					for (std::vector<struct dnet_io_attr>::iterator it = tmp_ios.begin(); it != tmp_ios.end(); ++it) {
-						int cmp = dnet_id_cmp_str(it->id, io->id);
+				memcpy(key.id, ios[i].id, DNET_ID_SIZE);
+				if (ctx->pending.count(key))
+					tmp_ios.push_back(ios[i]);
+			}
+			pthread_mutex_unlock(&ctx->lock);
 
-						if (cmp == 0) {
-							tmp_ios.erase(it);
-							break;
-						}
-					}
+			if (tmp_ios.empty())
+				break;
 
-					dnet_convert_io_attr(io);
+			ctx->ios.push_back(std::vector<struct dnet_io_attr>());
+			ctx->ios.back().swap(tmp_ios);
 
-					uint64_t size = dnet_bswap64(io->size);
+			std::vector<struct dnet_io_attr> &group_ios = ctx->ios.back();
 
-					std::string str;
+			num = dnet_bulk_read_object(m_node, &group_ios[0], group_ios.size(), *group, cflags, bulk_read_complete, ctx);
+			if (num < 0) {
+				dnet_log_raw(m_node, DNET_LOG_ERROR, "Failed to read bulk data: group: %d: err: %s: %d\n",
+						*group, strerror(-num), num);
+				failed << " " << *group << ": " << strerror(-num) << ";";
+				err = num;
+				continue;
+			}
 
-					str.append((char *)io->id, DNET_ID_SIZE);
-					str.append((char *)&size, 8);
-					str.append((const char *)(io + 1), io->size);
+			struct timeval tv;
+			struct timespec ts;
+
+			gettimeofday(&tv, NULL);
+			ts.tv_sec = tv.tv_sec + dnet_get_wait_timeout(m_node);
+			ts.tv_nsec = tv.tv_usec * 1000;
+
+			/* transactions are completed by the checker when they time out, but it may be late */
+			pthread_mutex_lock(&ctx->lock);
+			ctx->sent += num;
+			int wait_err = 0;
+			while ((ctx->completed != ctx->sent) && !wait_err)
+				wait_err = pthread_cond_timedwait(&ctx->wait_cond, &ctx->lock, &ts);
+			pthread_mutex_unlock(&ctx->lock);
+
+			if (wait_err) {
+				dnet_log_raw(m_node, DNET_LOG_ERROR, "Failed to read bulk data: group: %d: "
+						"timed out waiting for %d transactions\n", *group, num);
+				failed << " " << *group << ": " << strerror(wait_err) << ";";
+				err = -wait_err;
+			}
+		}
+	} catch (const std::bad_alloc &) {
+		oom = true;
+	}
 
-					ret.push_back(str);
+	/* late replies are dropped, wait only for handler calls which are already running */
+	pthread_mutex_lock(&ctx->lock);
+	ctx->abandoned = true;
+	while (ctx->calls)
+		pthread_cond_wait(&ctx->wait_cond, &ctx->lock);
+
+	size_t missing = ctx->pending.size();
+	std::string error = ctx->error;
+	if (!err && ctx->status) {
+		err = ctx->status;
+		failed << " transaction error: " << strerror(-err) << ";";
+	}
+	bool last = (ctx->completed == ctx->sent);
+	pthread_mutex_unlock(&ctx->lock);
 
-					data += sizeof(struct dnet_io_attr) + io->size;
-					d->size -= sizeof(struct dnet_io_attr) + io->size;
-				}
+	if (last)
+		delete ctx;
 
-				free(d->data);
-			}
+	if (!error.empty())
+		throw std::runtime_error("bulk read handler failed: " + error);
 
-			free(data);
-		}
+	if (oom)
+		throw std::bad_alloc();
+
+	/* missing keys may be stored in groups which were not asked */
+	if (missing && err) {
+		std::ostringstream str;
+		str << "bulk read: " << missing << " keys were not read, errors:" << failed.str();
+		throw std::runtime_error(str.str());
 	}
 
-	return ret;
+	return missing;
+}
+
+std::vector<std::string> node::bulk_read(const std::vector<struct dnet_io_attr> &ios, uint64_t cflags)
+{
+	bulk_read_collector collector;
+
+	bulk_read(ios, collector, cflags);
+	return collector.ret;
 }
 
 std::vector<std::string> node::bulk_read(const std::vector<std::string> &keys, uint64_t cflags)
@@ -1355,12 +1557,9 @@ std::vector<std::string> node::bulk_read(const std::vector<std::string> &keys, u
 	return bulk_read(ios, cflags);
 }
 
-std::string node::bulk_write(const std::vector<struct dnet_io_attr> &ios, const std::vector<std::string> &data, uint64_t cflags)
+static void bulk_write_prepare(const std::vector<struct dnet_io_attr> &ios, const std::vector<std::string> &data,
+		uint64_t cflags, std::vector<struct dnet_io_control> &ctls)
 {
-	std::vector<struct dnet_io_control> ctls;
-	unsigned int i;
-	int err;
-
 	if (ios.size() != data.size()) {
 		std::ostringstream string;
 		string << "BULK_WRITE: ios doesn't meet data: io.size: " << ios.size() << ", data.size: " << data.size();
@@ -1369,7 +1568,7 @@ std::string node::bulk_write(const std::vector<struct dnet_io_attr> &ios, const
 
 	ctls.reserve(ios.size());
 
-	for(i = 0; i < ios.size(); ++i) {
+	for (unsigned int i = 0; i < ios.size(); ++i) {
 		struct dnet_io_control ctl;
 		memset(&ctl, 0, sizeof(ctl));
 
@@ -1385,6 +1584,14 @@ std::string node::bulk_write(const std::vector<struct dnet_io_attr> &ios, const
 
 		ctls.push_back(ctl);
 	}
+}
+
+std::string node::bulk_write(const std::vector<struct dnet_io_attr> &ios, const std::vector<std::string> &data, uint64_t cflags)
+{
+	std::vector<struct dnet_io_control> ctls;
+	int err;
+
+	bulk_write_prepare(ios, data, cflags, ctls);
 
 	struct dnet_range_data ret = dnet_bulk_write(m_node, &ctls[0], ctls.size(), &err);
 	if (err < 0) {
@@ -1399,7 +1606,120 @@ std::string node::bulk_write(const std::vector<struct dnet_io_attr> &ios, const
 	return ret_str;
 }
 
+size_t node::bulk_write(const std::vector<struct dnet_io_attr> &ios, const std::vector<std::string> &data,
+		std::vector<int> &status, uint64_t cflags)
+{
+	std::vector<struct dnet_io_control> ctls;
+
+	bulk_write_prepare(ios, data, cflags, ctls);
+
+	status.resize(ctls.size());
+	if (ctls.empty())
+		return 0;
+
+	int err = dnet_bulk_write_status(m_node, &ctls[0], ctls.size(), &status[0], NULL);
+	if (err < 0) {
+		std::ostringstream string;
+		string << "BULK_WRITE: objects: " << ctls.size() << ", err: " << err;
+		throw std::runtime_error(string.str());
+	}
+
+	return err;
+}
+
 void node::set_timeouts(const int wait_timeout, const int check_timeout)
 {
 	dnet_set_timeouts(m_node, wait_timeout, check_timeout);
 }
+
+async_result node::read_data_async(struct dnet_id &id, uint64_t offset, uint64_t size,
+		uint64_t cflags, uint32_t ioflags, async_handler *handler)
+{
+	struct dnet_io_control ctl;
+	int *g = NULL, num;
+
+	memset(&ctl, 0, sizeof(ctl));
+
+	ctl.fd = -1;
+	ctl.cmd = DNET_CMD_READ;
+	ctl.cflags = DNET_FLAGS_NEED_ACK | cflags;
+
+	ctl.io.size = size;
+	ctl.io.offset = offset;
+	ctl.io.flags = ioflags;
+	ctl.io.type = id.type;
+
+	memcpy(ctl.io.id, id.id, DNET_ID_SIZE);
+	memcpy(ctl.io.parent, id.id, DNET_ID_SIZE);
+	memcpy(&ctl.id, &id, sizeof(struct dnet_id));
+
+	async_result res(m_node, DNET_CMD_READ, handler);
+
+	num = dnet_mix_states(m_node, &id, &g);
+	if (num < 0)
+		num = 0;
+
+	res.start_read(ctl, g, num);
+	free(g);
+
+	return res;
+}
+
+async_result node::write_data_async(struct dnet_id &id, const std::string &str,
+		uint64_t remote_offset, uint64_t cflags, unsigned int ioflags, async_handler *handler)
+{
+	struct dnet_io_control ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+
+	ctl.fd = -1;
+	ctl.cmd = DNET_CMD_WRITE;
+	ctl.cflags = DNET_FLAGS_NEED_ACK | cflags;
+
+	ctl.io.flags = ioflags;
+	ctl.io.offset = remote_offset;
+	ctl.io.size = str.size();
+	ctl.io.type = id.type;
+	ctl.io.num = str.size() + remote_offset;
+
+	memcpy(ctl.io.id, id.id, DNET_ID_SIZE);
+	memcpy(ctl.io.parent, id.id, DNET_ID_SIZE);
+	memcpy(&ctl.id, &id, sizeof(struct dnet_id));
+
+	async_result res(m_node, DNET_CMD_WRITE, handler);
+	res.start_write(ctl, str);
+
+	return res;
+}
+
+async_result node::lookup_async(const struct dnet_id &id, async_handler *handler)
+{
+	struct dnet_id raw = id;
+
+	async_result res(m_node, DNET_CMD_LOOKUP, handler);
+	res.start_lookup(raw, 0);
+
+	return res;
+}
+
+async_result node::remove_async(struct dnet_id &id, uint64_t cflags, uint64_t ioflags, async_handler *handler)
+{
+	struct dnet_io_control ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+
+	ctl.fd = -1;
+	ctl.cmd = DNET_CMD_DEL;
+	ctl.cflags = DNET_FLAGS_NEED_ACK | DNET_ATTR_DELETE_HISTORY | cflags;
+
+	ctl.io.flags = ioflags;
+
+	memcpy(ctl.io.id, id.id, DNET_ID_SIZE);
+	memcpy(ctl.io.parent, id.id, DNET_ID_SIZE);
+	memcpy(&ctl.id, &id, sizeof(struct dnet_id));
+
+	async_result res(m_node, DNET_CMD_DEL, handler);
+	res.start_remove(ctl);
+
+	return res;
+}
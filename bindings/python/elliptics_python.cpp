@@ -541,7 +541,17 @@ BOOST_PYTHON_MODULE(libelliptics_python) {
 		.def_readwrite("check_timeout", &dnet_config::check_timeout)
 		.def_readwrite("io_thread_num", &dnet_config::io_thread_num)
 		.def_readwrite("nonblocking_io_thread_num", &dnet_config::nonblocking_io_thread_num)
+		.def_readwrite("io_thread_num_max", &dnet_config::io_thread_num_max)
+		.def_readwrite("nonblocking_io_thread_num_max", &dnet_config::nonblocking_io_thread_num_max)
 		.def_readwrite("net_thread_num", &dnet_config::net_thread_num)
+		.def_readwrite("net_event_num", &dnet_config::net_event_num)
+		.def_readwrite("net_recv_buffer_size", &dnet_config::net_recv_buffer_size)
+		.def_readwrite("send_queue_limit", &dnet_config::send_queue_limit)
+		.def_readwrite("send_queue_global_limit", &dnet_config::send_queue_global_limit)
+		.def_readwrite("net_stripe_num", &dnet_config::net_stripe_num)
+		.def_readwrite("net_stripe_large_size", &dnet_config::net_stripe_large_size)
+		.def_readwrite("bulk_write_window", &dnet_config::bulk_write_window)
+		.def_readwrite("hedged_read_delay", &dnet_config::hedged_read_delay)
 		.def_readwrite("client_prio", &dnet_config::client_prio)
 	;
 	
@@ -320,6 +320,11 @@ class cache_t {
 
 using namespace ioremap::cache;
 
+static void dnet_cache_data_destroy(void *priv)
+{
+	delete (boost::shared_ptr<raw_data_t> *)priv;
+}
+
 int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, char *data)
 {
 	struct dnet_node *n = st->n;
@@ -353,8 +358,28 @@ int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, char *dat
 					break;
 				}
 
-				io->size = d->size();
-				err = dnet_send_read_data(st, cmd, io, (char *)d->data().data() + io->offset, -1, io->offset, 0);
+				/* zero size means the rest of the object, like backends read it */
+				if (!io->size)
+					io->size = d->size() - io->offset;
+
+				/*
+				 * Send queue holds a reference to the cached data,
+				 * so it is neither copied nor freed if entry is replaced meanwhile.
+				 */
+				{
+					boost::shared_ptr<raw_data_t> *ref = new boost::shared_ptr<raw_data_t>(d);
+					struct dnet_io_buf *buf;
+
+					buf = dnet_io_buf_wrap(d->data().data(), d->size(), dnet_cache_data_destroy, ref);
+					if (!buf) {
+						delete ref;
+						err = -ENOMEM;
+						break;
+					}
+
+					err = dnet_send_read_data_buf(st, cmd, io, buf, io->offset);
+					dnet_io_buf_put(buf);
+				}
 				break;
 			case DNET_CMD_DEL:
 				err = -ENOENT;
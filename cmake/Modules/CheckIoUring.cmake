@@ -0,0 +1,30 @@
+# Check whether io_uring interface is available
+
+include(CheckCSourceCompiles)
+
+if (UNIX OR MINGW)
+    SET(CMAKE_REQUIRED_DEFINITIONS -Werror-implicit-function-declaration)
+endif()
+
+check_c_source_compiles("#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+int main()
+{
+    struct io_uring_params p;
+    struct io_uring_sqe sqe;
+
+    memset(&p, 0, sizeof(p));
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.poll32_events = 0;
+    sqe.opcode = IORING_OP_TIMEOUT;
+
+    return syscall(__NR_io_uring_setup, 1, &p) < 0 || syscall(__NR_io_uring_enter, 0, 0, 0, 0, NULL, 0) < 0;
+}" HAVE_IO_URING_SUPPORT)
+unset(CMAKE_REQUIRED_DEFINITIONS)
+
+if(HAVE_IO_URING_SUPPORT)
+    add_definitions(-DHAVE_IO_URING_SUPPORT=1)
+endif()
+message(STATUS "io_uring support: ${HAVE_IO_URING_SUPPORT}")
@@ -100,8 +100,28 @@ static int dnet_simple_set(struct dnet_config_backend *b __unused, char *key, ch
 		dnet_cfg_state.io_thread_num = value;
 	else if (!strcmp(key, "nonblocking_io_thread_num"))
 		dnet_cfg_state.nonblocking_io_thread_num = value;
+	else if (!strcmp(key, "io_thread_num_max"))
+		dnet_cfg_state.io_thread_num_max = value;
+	else if (!strcmp(key, "nonblocking_io_thread_num_max"))
+		dnet_cfg_state.nonblocking_io_thread_num_max = value;
 	else if (!strcmp(key, "net_thread_num"))
 		dnet_cfg_state.net_thread_num = value;
+	else if (!strcmp(key, "net_event_num"))
+		dnet_cfg_state.net_event_num = value;
+	else if (!strcmp(key, "net_recv_buffer_size"))
+		dnet_cfg_state.net_recv_buffer_size = value;
+	else if (!strcmp(key, "send_queue_limit"))
+		dnet_cfg_state.send_queue_limit = value;
+	else if (!strcmp(key, "send_queue_global_limit"))
+		dnet_cfg_state.send_queue_global_limit = value;
+	else if (!strcmp(key, "net_stripe_num"))
+		dnet_cfg_state.net_stripe_num = value;
+	else if (!strcmp(key, "net_stripe_large_size"))
+		dnet_cfg_state.net_stripe_large_size = value;
+	else if (!strcmp(key, "bulk_write_window"))
+		dnet_cfg_state.bulk_write_window = value;
+	else if (!strcmp(key, "hedged_read_delay"))
+		dnet_cfg_state.hedged_read_delay = value;
 	else if (!strcmp(key, "bg_ionice_class"))
 		dnet_cfg_state.bg_ionice_class = value;
 	else if (!strcmp(key, "bg_ionice_prio"))
@@ -229,6 +249,21 @@ static int dnet_set_history_env(struct dnet_config_backend *b __unused, char *ke
 	return 0;
 }
 
+static int dnet_set_cpu_list(struct dnet_config_backend *b __unused, char *key, char *value)
+{
+	char *dst;
+
+	if (!strcmp(key, "net_thread_cpus"))
+		dst = dnet_cfg_state.net_thread_cpus;
+	else if (!strcmp(key, "io_thread_cpus"))
+		dst = dnet_cfg_state.io_thread_cpus;
+	else
+		dst = dnet_cfg_state.nonblocking_io_thread_cpus;
+
+	snprintf(dst, DNET_MAX_CPULISTLEN, "%s", value);
+	return 0;
+}
+
 static int dnet_set_cache_size(struct dnet_config_backend *b __unused, char *key __unused, char *value)
 {
 	dnet_cfg_state.cache_size = strtoull(value, NULL, 0);
@@ -252,7 +287,20 @@ static struct dnet_config_entry dnet_cfg_entries[] = {
 	{"history", dnet_set_history_env},
 	{"io_thread_num", dnet_simple_set},
 	{"nonblocking_io_thread_num", dnet_simple_set},
+	{"io_thread_num_max", dnet_simple_set},
+	{"nonblocking_io_thread_num_max", dnet_simple_set},
 	{"net_thread_num", dnet_simple_set},
+	{"net_event_num", dnet_simple_set},
+	{"net_recv_buffer_size", dnet_simple_set},
+	{"send_queue_limit", dnet_simple_set},
+	{"send_queue_global_limit", dnet_simple_set},
+	{"net_stripe_num", dnet_simple_set},
+	{"net_stripe_large_size", dnet_simple_set},
+	{"bulk_write_window", dnet_simple_set},
+	{"hedged_read_delay", dnet_simple_set},
+	{"net_thread_cpus", dnet_set_cpu_list},
+	{"io_thread_cpus", dnet_set_cpu_list},
+	{"nonblocking_io_thread_cpus", dnet_set_cpu_list},
 	{"bg_ionice_class", dnet_simple_set},
 	{"bg_ionice_prio", dnet_simple_set},
 	{"removal_delay", dnet_simple_set},
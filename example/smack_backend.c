@@ -152,6 +152,7 @@ err_out_exit:
 static int smack_backend_read(struct smack_backend *s, void *state, struct dnet_cmd *cmd, void *iodata)
 {
 	struct dnet_io_attr *io = iodata;
+	struct dnet_io_buf *buf;
 	char *data;
 	struct index idx;
 	int err;
@@ -166,9 +167,17 @@ static int smack_backend_read(struct smack_backend *s, void *state, struct dnet_
 		goto err_out_exit;
 
 	io->size = idx.data_size;
-	err = dnet_send_read_data(state, cmd, io, data, -1, io->offset, 0);
-	if (err)
+
+	/* send queue takes over @data and frees it once reply is sent */
+	buf = dnet_io_buf_wrap(data, idx.data_size, free, data);
+	if (!buf) {
+		err = -ENOMEM;
 		goto err_out_free;
+	}
+
+	err = dnet_send_read_data_buf(state, cmd, io, buf, 0);
+	dnet_io_buf_put(buf);
+	goto err_out_exit;
 
 err_out_free:
 	free(data);
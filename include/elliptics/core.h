@@ -40,6 +40,20 @@
  */
 #define DNET_COPY_IO_SIZE	512
 
+/*
+ * Bulk write packs objects into single transaction until either
+ * number of objects or total size limit is reached.
+ */
+#define DNET_BULK_WRITE_BATCH_NUM	128
+#define DNET_BULK_WRITE_BATCH_SIZE	(1024*1024)
+#define DNET_DEFAULT_BULK_WRITE_WINDOW	4
+
+/*
+ * Adaptive hedged read delay (in microseconds) is never shorter than this,
+ * so that reads are not duplicated just because of scheduling jitter.
+ */
+#define DNET_HEDGED_READ_MIN_DELAY	1000
+
 #ifndef HAVE_LARGEFILE_SUPPORT
 #define O_LARGEFILE		0
 #endif
@@ -65,6 +79,35 @@
 
 #define DNET_DEFAULT_STALL_TRANSACTIONS 5
 
+/*
+ * Default number of events harvested by network thread per wakeup.
+ */
+#define DNET_DEFAULT_NET_EVENT_NUM	64
+
+/*
+ * Number of bytes single state may receive and send per network thread wakeup
+ * before the rest of ready states get their share.
+ */
+#define DNET_DEFAULT_NET_STATE_BUDGET	(1024 * 1024)
+
+/*
+ * Default size of per-connection receive buffer.
+ */
+#define DNET_DEFAULT_NET_RECV_BUFFER_SIZE	(16 * 1024)
+
+/*
+ * Default limits of memory queued for sending to single client and to all clients.
+ */
+#define DNET_DEFAULT_SEND_QUEUE_LIMIT		(64 * 1024 * 1024ULL)
+#define DNET_DEFAULT_SEND_QUEUE_GLOBAL_LIMIT	(1024 * 1024 * 1024ULL)
+
+/*
+ * Maximum number of connections to single remote node and default size
+ * of the request which goes over dedicated connection.
+ */
+#define DNET_MAX_NET_STRIPE_NUM			32
+#define DNET_DEFAULT_NET_STRIPE_LARGE_SIZE	(1024 * 1024ULL)
+
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
 #undef offsetof
@@ -127,6 +127,66 @@ class callback {
 		int			complete;
 };
 
+class async_handler {
+	public:
+		virtual ~async_handler() {};
+
+		/*
+		 * Called once from network or IO thread when all transactions of the request
+		 * have completed, @data is what synchronous counterpart of the request returns.
+		 * It must not block, since it delays every other reply served by that thread.
+		 */
+		virtual void complete(int err, const std::string &data) = 0;
+};
+
+struct async_state;
+
+/*
+ * Result of the request started by one of node::*_async() methods.
+ * Copies share the same request, it is safe to drop all of them
+ * before request completes.
+ */
+class async_result {
+	public:
+		async_result(const async_result &other);
+		async_result &operator =(const async_result &other);
+		~async_result();
+
+		bool			ready();
+
+		/* waits for request completion and returns its error code */
+		int			wait();
+
+		/* waits for request completion and returns its data, throws if request failed */
+		std::string		get();
+
+	private:
+		friend class node;
+
+		async_result(struct dnet_node *n, int cmd, async_handler *handler);
+
+		void			start_read(struct dnet_io_control &ctl, int *groups, int group_num);
+		void			start_write(struct dnet_io_control &ctl, const std::string &data);
+		void			start_lookup(struct dnet_id &id, uint64_t cflags);
+		void			start_remove(struct dnet_io_control &ctl);
+
+		static int		complete_callback(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv);
+
+		struct async_state	*m_state;
+};
+
+class bulk_read_handler {
+	public:
+		virtual ~bulk_read_handler() {};
+
+		/*
+		 * Called from network or IO thread for every found object, possibly from
+		 * several threads at once. @data points to @io.size bytes of object right
+		 * in the received buffer and is valid only until handler returns.
+		 */
+		virtual void object(const struct dnet_io_attr &io, const char *data) = 0;
+};
+
 class node {
 	public:
 		/* we shold use logger and proper copy constructor here, but not this time */
@@ -171,10 +231,13 @@ class node {
 		std::string		read_latest(const std::string &remote, uint64_t offset, uint64_t size,
 						uint64_t cflags, uint32_t ioflags, int type);
 
+		/* @quorum is number of groups write has to succeed in before return, 0 means all of them */
 		std::string		write_data_wait(struct dnet_id &id, const std::string &str,
-						uint64_t remote_offset, uint64_t cflags, unsigned int ioflags);
+						uint64_t remote_offset, uint64_t cflags, unsigned int ioflags,
+						int quorum = 0);
 		std::string		write_data_wait(const std::string &remote, const std::string &str,
-						uint64_t remote_offset, uint64_t cflags, unsigned int ioflags, int type);
+						uint64_t remote_offset, uint64_t cflags, unsigned int ioflags, int type,
+						int quorum = 0);
 
 		std::string		write_prepare(const std::string &remote, const std::string &str, uint64_t remote_offset,
 						uint64_t psize, uint64_t cflags, unsigned int ioflags, int type);
@@ -246,9 +309,40 @@ class node {
 		std::vector<std::string>	bulk_read(const std::vector<struct dnet_io_attr> &ios, uint64_t cflags = 0);
 		std::vector<std::string>	bulk_read(const std::vector<std::string> &keys, uint64_t cflags = 0);
 
+		/*
+		 * Hands objects to @handler as they arrive, next group is asked only for still missing keys.
+		 * Every group is waited for no longer than node wait timeout, replies which come after
+		 * bulk_read() has returned are dropped. Returns number of keys which were not found
+		 * in any group, throws if some keys are missing and some group could not be asked
+		 * or did not reply in time.
+		 */
+		size_t			bulk_read(const std::vector<struct dnet_io_attr> &ios, bulk_read_handler &handler,
+						uint64_t cflags = 0);
+
 		std::string		bulk_write(const std::vector<struct dnet_io_attr> &ios,
 						const std::vector<std::string> &data, uint64_t cflags);
 
+		/*
+		 * @status gets per-object result: zero if object was written, negative error otherwise,
+		 * so that only failed objects can be retried. Returns number of written objects.
+		 */
+		size_t			bulk_write(const std::vector<struct dnet_io_attr> &ios,
+						const std::vector<std::string> &data, std::vector<int> &status,
+						uint64_t cflags = 0);
+
+		/*
+		 * Asynchronous requests return as soon as transactions are sent,
+		 * @handler (if any) must live until it is called.
+		 */
+		async_result		read_data_async(struct dnet_id &id, uint64_t offset, uint64_t size,
+						uint64_t cflags, uint32_t ioflags, async_handler *handler = NULL);
+		async_result		write_data_async(struct dnet_id &id, const std::string &str,
+						uint64_t remote_offset, uint64_t cflags, unsigned int ioflags,
+						async_handler *handler = NULL);
+		async_result		lookup_async(const struct dnet_id &id, async_handler *handler = NULL);
+		async_result		remove_async(struct dnet_id &id, uint64_t cflags = 0, uint64_t ioflags = 0,
+						async_handler *handler = NULL);
+
 	protected:
 		int			write_data_ll(struct dnet_id *id, void *remote, unsigned int remote_len,
 							void *data, unsigned int size, callback &c,
@@ -165,6 +165,9 @@ struct dnet_read_latest_prepare {
 
 	int				*group;
 	int				group_num;
+
+	/* number of leading groups which have the latest version of the object */
+	int				latest_num;
 };
 int dnet_read_latest_prepare(struct dnet_read_latest_prepare *pr);
 
@@ -188,6 +191,31 @@ struct dnet_range_data *dnet_read_range(struct dnet_node *n, struct dnet_io_attr
 int __attribute__((weak)) dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io,
 		void *data, int fd, uint64_t offset, int close_on_exit);
 
+/*
+ * Reference counted data buffer, which can be queued for sending without copying.
+ *
+ * dnet_io_buf_alloc() allocates buffer together with @size bytes of data,
+ * dnet_io_buf_wrap() takes existing memory, @destroy(@priv) is called
+ * when the last reference is dropped, it may be NULL.
+ *
+ * Both return buffer with a single reference held by the caller.
+ */
+struct dnet_io_buf;
+
+struct dnet_io_buf *dnet_io_buf_alloc(size_t size);
+struct dnet_io_buf *dnet_io_buf_wrap(void *data, size_t size, void (* destroy)(void *priv), void *priv);
+struct dnet_io_buf *dnet_io_buf_get(struct dnet_io_buf *buf);
+void dnet_io_buf_put(struct dnet_io_buf *buf);
+void *dnet_io_buf_data(struct dnet_io_buf *buf);
+size_t dnet_io_buf_size(struct dnet_io_buf *buf);
+
+/*
+ * Sends @io->size bytes starting at @offset in @buf as a read reply.
+ * Send queue grabs its own reference to @buf, data is not copied.
+ */
+int dnet_send_read_data_buf(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io,
+		struct dnet_io_buf *buf, uint64_t offset);
+
 /*
  * Reads given file from the storage. If there are multiple transformation functions,
  * they will be tried one after another.
@@ -219,6 +247,17 @@ int dnet_write_object(struct dnet_node *n, struct dnet_io_control *ctl);
 /* Returns size of the reply or negative error value */
 int __attribute__((weak)) dnet_write_data_wait(struct dnet_node *n, struct dnet_io_control *ctl, void **result);
 
+/*
+ * Quorum write: returns as soon as @quorum groups have acknowledged the write,
+ * 0 means to wait for all of them like dnet_write_data_wait() does.
+ * Writes to the remaining groups complete in background, their results are logged
+ * and counted in DNET_CNTR_WRITE_LATE node counter, @result only contains replies
+ * received before return. It is an error (-EIO) if fewer than @quorum groups succeeded.
+ * Only @ctl->data is copied into the requests, @ctl->fd would be read after return,
+ * so file writes (@ctl->fd >= 0) with non-zero @quorum are rejected with -EINVAL.
+ */
+int dnet_write_data_wait_quorum(struct dnet_node *n, struct dnet_io_control *ctl, void **result, int quorum);
+
 /*
  * Sends given file to the remote nodes and waits until all of them ack the write.
  *
@@ -241,14 +280,18 @@ enum dnet_log_level {
 
 #define DNET_MAX_ADDRLEN		256
 #define DNET_MAX_PORTLEN		8
+#define DNET_MAX_CPULISTLEN		128
 
 /* cfg->flags */
 #define DNET_CFG_JOIN_NETWORK		(1<<0)		/* given node joins network and becomes part of the storage */
 #define DNET_CFG_NO_ROUTE_LIST		(1<<1)		/* do not request route table from remote nodes */
-#define DNET_CFG_MIX_STATES		(1<<2)		/* mix states according to their weights before reading data */
+#define DNET_CFG_MIX_STATES		(1<<2)		/* order groups by expected response time before reading data */
 #define DNET_CFG_NO_CSUM		(1<<3)		/* globally disable checksum verification and update */
 #define DNET_CFG_NO_META		(1<<4)		/* do not write metadata */
 #define DNET_CFG_RANDOMIZE_STATES	(1<<5)		/* randomize states for read requests */
+#define DNET_CFG_IO_URING		(1<<6)		/* use io_uring network engine instead of epoll if supported */
+#define DNET_CFG_REUSEPORT		(1<<7)		/* open SO_REUSEPORT listening socket per network thread */
+#define DNET_CFG_IO_SHARED_QUEUE	(1<<8)		/* IO threads share single queue, broadcast wakeups (old dispatch, for comparison) */
 
 struct dnet_log {
 	/*
@@ -426,6 +469,65 @@ struct dnet_config
 
 	uint64_t		cache_size;
 
+	/*
+	 * Maximum number of events network thread harvests per single epoll_wait() call
+	 */
+	int			net_event_num;
+
+	/*
+	 * Size of per-connection receive buffer, multiple small commands are read
+	 * from socket at once and parsed from it. Negative value disables buffering.
+	 */
+	int			net_recv_buffer_size;
+
+	/*
+	 * CPU lists like "0-7,16-23" network, blocking and nonblocking IO threads are bound to.
+	 * Every thread is pinned to single CPU taken from the list round-robin,
+	 * empty list leaves threads unbound.
+	 */
+	char			net_thread_cpus[DNET_MAX_CPULISTLEN];
+	char			io_thread_cpus[DNET_MAX_CPULISTLEN];
+	char			nonblocking_io_thread_cpus[DNET_MAX_CPULISTLEN];
+
+	/*
+	 * Upper limits IO pools may grow to when requests queue up or wait
+	 * for too long, io_thread_num and nonblocking_io_thread_num are lower limits.
+	 * Values less than lower limits keep pools fixed-size.
+	 */
+	int			io_thread_num_max;
+	int			nonblocking_io_thread_num_max;
+
+	/*
+	 * Limits of memory queued for sending to single client connection and to all clients.
+	 * Server stops reading requests from client connection while either limit is exceeded.
+	 * Zero means default limits, -1 disables limit.
+	 */
+	uint64_t		send_queue_limit;
+	uint64_t		send_queue_global_limit;
+
+	/*
+	 * Number of TCP connections opened to every remote node. Data requests are spread
+	 * across them by transaction, requests which read or write at least net_stripe_large_size
+	 * bytes use the last connection only, so that they do not delay small ones.
+	 * Zero or one keeps single connection per node.
+	 */
+	int			net_stripe_num;
+	uint64_t		net_stripe_large_size;
+
+	/*
+	 * Maximum number of bulk write transactions in flight to single remote node.
+	 * Zero means default window.
+	 */
+	int			bulk_write_window;
+
+	/*
+	 * Hedged read delay in milliseconds: if group being read does not reply within it,
+	 * the same read is sent to the next group, the first reply wins and the rest are cancelled.
+	 * Negative value means delay is twice as long as average read time of the node being read.
+	 * Zero disables hedged reads, groups are read one after another.
+	 */
+	int			hedged_read_delay;
+
 	/* so that we do not change major version frequently */
 	int			reserved_for_future_use[12];
 };
@@ -915,11 +1017,36 @@ int dnet_get_routes(struct dnet_node *n, struct dnet_id **ids, struct dnet_addr
 int dnet_send_cmd(struct dnet_node *n, struct dnet_id *id, struct sph *h, void **ret);
 int dnet_send_cmd_nolock(struct dnet_node *n, struct dnet_id *id, struct sph *e, void **ret);
 
+/*
+ * Sends bulk read request to every node which owns some of @ios in given group without waiting.
+ * @complete is called for every read object as it arrives and once per transaction with destroy flag.
+ * @ios are sorted and must live until all transactions are completed.
+ * Returns number of transactions (and thus destroy completions) or negative error.
+ */
+int dnet_bulk_read_object(struct dnet_node *n, struct dnet_io_attr *ios, uint32_t io_num, int group_id, uint64_t cflags,
+	int (* complete)(struct dnet_net_state *state, struct dnet_cmd *cmd, void *priv),
+	void *priv);
 struct dnet_range_data *dnet_bulk_read(struct dnet_node *n, struct dnet_io_attr *ios, uint32_t io_num, int group_id, uint64_t cflags, int *errp);
+
+/*
+ * Writes every object from @ctl (data has to be in memory, @fd is not supported) into all node's groups.
+ * Objects and their metadata are packed into bulk write transactions, at most bulk_write_window
+ * of them are in flight to every remote node. Servers have to support DNET_CMD_BULK_WRITE,
+ * dnet_bulk_write() sends every object with its own WRITE command instead.
+ * @status (if not NULL) gets per-object result: zero if object was written into at least
+ * one group, negative error otherwise, so that only failed objects can be retried.
+ * If @reply is not NULL, it gets concatenated dnet_addr and dnet_cmd (with write status)
+ * for every replied copy, which should be freed by caller.
+ * Returns number of written objects or negative error.
+ */
+int dnet_bulk_write_status(struct dnet_node *n, struct dnet_io_control *ctl, int ctl_num, int *status,
+		struct dnet_range_data *reply);
 struct dnet_range_data dnet_bulk_write(struct dnet_node *n, struct dnet_io_control *ctl, int ctl_num, int *errp);
 
 int dnet_flags(struct dnet_node *n);
 void dnet_set_timeouts(struct dnet_node *n, int wait_timeout, int check_timeout);
+/* Seconds transaction waits for reply before it is completed with timeout error */
+int dnet_get_wait_timeout(struct dnet_node *n);
 
 #define DNET_CONF_ADDR_DELIM	':'
 int dnet_parse_addr(char *addr, struct dnet_config *cfg);
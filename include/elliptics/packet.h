@@ -57,6 +57,7 @@ enum dnet_commands {
 	DNET_CMD_AUTH,				/* Authentification cookie check */
 	DNET_CMD_BULK_READ,			/* Read a number of ids at one time */
 	DNET_CMD_DEFRAG,			/* Start defragmentation process if backend supports it */
+	DNET_CMD_BULK_WRITE,			/* Write a number of objects (and their metadata) at one time */
 
 	DNET_CMD_UNKNOWN,			/* This slot is allocated for statistics gathered for unknown commands */
 	__DNET_CMD_MAX,
@@ -89,6 +90,22 @@ enum dnet_counters {
 	DNET_CNTR_DBR_ERROR,			/* Kyoto Cabinet DB read error */
 	DNET_CNTR_DBW_SYSTEM,			/* Kyoto Cabinet DB write error KCESYSTEM */
 	DNET_CNTR_DBW_ERROR,			/* Kyoto Cabinet DB write error */
+	DNET_CNTR_RCV_POOL_HIT,			/* # receive buffers reused from network thread pools */
+	DNET_CNTR_RCV_POOL_MISS,		/* # receive buffers allocated with malloc() */
+	DNET_CNTR_IO_QUEUE,			/* # requests waiting in blocking IO pool queues */
+	DNET_CNTR_IO_ACTIVE,			/* # blocking IO threads processing requests */
+	DNET_CNTR_IO_THREADS,			/* # running blocking IO threads */
+	DNET_CNTR_IO_WAIT_TIME,			/* average time requests wait in blocking IO queue, usecs */
+	DNET_CNTR_IO_HANDLE_TIME,		/* average time blocking IO threads process request, usecs */
+	DNET_CNTR_NB_IO_QUEUE,			/* # requests waiting in nonblocking IO pool queues */
+	DNET_CNTR_NB_IO_ACTIVE,			/* # nonblocking IO threads processing requests */
+	DNET_CNTR_NB_IO_THREADS,		/* # running nonblocking IO threads */
+	DNET_CNTR_NB_IO_WAIT_TIME,		/* average time requests wait in nonblocking IO queues, usecs */
+	DNET_CNTR_NB_IO_HANDLE_TIME,		/* average time nonblocking IO threads process request, usecs */
+	DNET_CNTR_SEND_QUEUE_SIZE,		/* # bytes of memory queued for sending to all connections */
+	DNET_CNTR_SEND_THROTTLED,		/* # client connections which are not read because of send queue limits */
+	DNET_CNTR_SEND_THROTTLE_NUM,		/* # times client connections were throttled */
+	DNET_CNTR_WRITE_LATE,			/* # replica writes completed after quorum write returned */
 	DNET_CNTR_UNKNOWN,			/* This slot is allocated for statistics gathered for unknown counters */
 	__DNET_CNTR_MAX,
 };
@@ -186,6 +203,9 @@ static inline void dnet_convert_cmd(struct dnet_cmd *cmd)
 /* Bulk request for checking files */
 #define DNET_ATTR_BULK_CHECK			(1ULL<<32)
 
+/* Auth request is sent over extra connection of joined server, such connection is never throttled */
+#define DNET_ATTR_SERVER_STRIPE			(1ULL<<32)
+
 /* Fill ctime/mtime from metadata when processing DNET_CMD_LOOKUP */
 #define DNET_ATTR_META_TIMES			(1ULL<<33)
 
@@ -19,6 +19,8 @@
 #include <sys/mman.h>
 #include <sys/wait.h>
 
+#include <ctype.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +54,54 @@ long dnet_get_id(void)
 {
 	return syscall(SYS_gettid);
 }
+
+/*
+ * Binds calling thread to given CPU
+ */
+int dnet_set_cpu(int cpu)
+{
+	unsigned long mask[DNET_CPU_MAX / (8 * sizeof(unsigned long))];
+	int bits = 8 * sizeof(unsigned long);
+
+	if (cpu < 0 || cpu >= DNET_CPU_MAX)
+		return -EINVAL;
+
+	memset(mask, 0, sizeof(mask));
+	mask[cpu / bits] |= 1UL << (cpu % bits);
+
+	if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) < 0)
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * NUMA node is exported as nodeN link in CPU's sysfs directory,
+ * machines without NUMA do not have it and everything lives in node 0.
+ */
+int dnet_cpu_node(int cpu)
+{
+	char path[128];
+	struct dirent *d;
+	DIR *dir;
+	int node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((d = readdir(dir)) != NULL) {
+		if (!strncmp(d->d_name, "node", 4) && isdigit(d->d_name[4])) {
+			node = atoi(d->d_name + 4);
+			break;
+		}
+	}
+
+	closedir(dir);
+	return node;
+}
 #else
 int dnet_set_name(char *name __attribute__ ((unused))) { return 0; }
 
@@ -59,6 +109,9 @@ long dnet_get_id(void)
 {
 	return pthread_self();
 }
+
+int dnet_set_cpu(int cpu __attribute__ ((unused))) { return -ENOTSUP; }
+int dnet_cpu_node(int cpu __attribute__ ((unused))) { return 0; }
 #endif
 
 #ifdef HAVE_SENDFILE4_SUPPORT
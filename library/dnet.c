@@ -257,6 +257,7 @@ static int dnet_cmd_join_client(struct dnet_net_state *st, struct dnet_cmd *cmd,
 		dnet_convert_raw_id(&ids[0]);
 
 	pthread_mutex_lock(&n->state_lock);
+	dnet_state_addr_unhash_nolock(st);
 	list_del_init(&st->state_entry);
 	list_del_init(&st->storage_state_entry);
 	pthread_mutex_unlock(&n->state_lock);
@@ -376,6 +377,8 @@ static int dnet_cmd_stat_count_global(struct dnet_net_state *orig, struct dnet_c
 		struct dnet_node *n, struct dnet_addr_stat *as)
 {
 	struct dnet_stat st;
+	struct dnet_work_pool_stat ps;
+	unsigned long long hit, miss;
 	int err = 0;
 
 	cmd->cmd = DNET_CMD_STAT_COUNT;
@@ -412,6 +415,28 @@ static int dnet_cmd_stat_count_global(struct dnet_net_state *orig, struct dnet_c
 	}
 	as->count[DNET_CNTR_NODE_FILES].count = n->cb->meta_total_elements(n->cb->command_private);
 
+	dnet_io_req_pool_stat(n, &hit, &miss);
+	as->count[DNET_CNTR_RCV_POOL_HIT].count = hit;
+	as->count[DNET_CNTR_RCV_POOL_MISS].count = miss;
+
+	dnet_work_pool_stat(n, 0, &ps);
+	as->count[DNET_CNTR_IO_QUEUE].count = ps.queued;
+	as->count[DNET_CNTR_IO_ACTIVE].count = ps.active;
+	as->count[DNET_CNTR_IO_THREADS].count = ps.threads;
+	as->count[DNET_CNTR_IO_WAIT_TIME].count = ps.wait_time;
+	as->count[DNET_CNTR_IO_HANDLE_TIME].count = ps.handle_time;
+
+	dnet_work_pool_stat(n, 1, &ps);
+	as->count[DNET_CNTR_NB_IO_QUEUE].count = ps.queued;
+	as->count[DNET_CNTR_NB_IO_ACTIVE].count = ps.active;
+	as->count[DNET_CNTR_NB_IO_THREADS].count = ps.threads;
+	as->count[DNET_CNTR_NB_IO_WAIT_TIME].count = ps.wait_time;
+	as->count[DNET_CNTR_NB_IO_HANDLE_TIME].count = ps.handle_time;
+
+	as->count[DNET_CNTR_SEND_QUEUE_SIZE].count = (unsigned long long)atomic_read(&n->send_queue_kb) << 10;
+	as->count[DNET_CNTR_SEND_THROTTLED].count = atomic_read(&n->send_throttled);
+	as->count[DNET_CNTR_SEND_THROTTLE_NUM].count = atomic_read(&n->send_throttle_num);
+
 	dnet_convert_addr_stat(as, as->num);
 
 	return dnet_send_reply(orig, cmd, as, sizeof(struct dnet_addr_stat) + __DNET_CNTR_MAX * sizeof(struct dnet_stat_count), 1);
@@ -499,7 +524,7 @@ static int dnet_cmd_status(struct dnet_net_state *orig, struct dnet_cmd *cmd __u
 	return dnet_send_reply(orig, cmd, st, sizeof(struct dnet_node_status), 1);
 }
 
-static int dnet_cmd_auth(struct dnet_net_state *orig, struct dnet_cmd *cmd __unused, void *data)
+static int dnet_cmd_auth(struct dnet_net_state *orig, struct dnet_cmd *cmd, void *data)
 {
 	struct dnet_node *n = orig->n;
 	struct dnet_auth *a = data;
@@ -515,13 +540,72 @@ static int dnet_cmd_auth(struct dnet_net_state *orig, struct dnet_cmd *cmd __unu
 		err = -EPERM;
 		dnet_log(n, DNET_LOG_ERROR, "%s: auth cookies do not match\n", dnet_state_dump_addr(orig));
 	} else {
-		dnet_log(n, DNET_LOG_INFO, "%s: authentication succeeded\n", dnet_state_dump_addr(orig));
+		if (cmd->flags & DNET_ATTR_SERVER_STRIPE)
+			orig->server_stripe = 1;
+
+		dnet_log(n, DNET_LOG_INFO, "%s: authentication succeeded%s\n", dnet_state_dump_addr(orig),
+				orig->server_stripe ? ", server stripe" : "");
 	}
 
 err_out_exit:
 	return err;
 }
 
+/*
+ * Bulk write request is a sequence of io attributes each followed by its data.
+ * Every entry is processed as standalone write command (metadata entries carry
+ * DNET_IO_FLAGS_META flag), on behalf of node's own state, so that replies of those
+ * writes are not sent. Instead every entry gets its own reply with write status
+ * and transaction is completed by the final ack.
+ */
+static int dnet_cmd_bulk_write(struct dnet_net_state *orig, struct dnet_cmd *cmd, void *data)
+{
+	struct dnet_node *n = orig->n;
+	unsigned long long size = cmd->size;
+	struct dnet_io_attr io;
+	struct dnet_cmd wcmd;
+	int err, num = 0;
+
+	while (size) {
+		if (size < sizeof(struct dnet_io_attr)) {
+			dnet_log(n, DNET_LOG_ERROR, "%s: bulk write: invalid size: entry: %d, rest_size: %llu\n",
+					dnet_dump_id(&cmd->id), num, size);
+			return -EINVAL;
+		}
+
+		memcpy(&io, data, sizeof(struct dnet_io_attr));
+		dnet_convert_io_attr(&io);
+
+		if (io.size > size - sizeof(struct dnet_io_attr)) {
+			dnet_log(n, DNET_LOG_ERROR, "%s: bulk write: invalid io size: entry: %d, size: %llu, rest_size: %llu\n",
+					dnet_dump_id_str(io.id), num, (unsigned long long)io.size, size);
+			return -EINVAL;
+		}
+
+		memset(&wcmd, 0, sizeof(struct dnet_cmd));
+		memcpy(wcmd.id.id, io.id, DNET_ID_SIZE);
+		wcmd.id.group_id = cmd->id.group_id;
+		wcmd.id.type = io.type;
+		wcmd.cmd = DNET_CMD_WRITE;
+		wcmd.flags = cmd->flags & ~(DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE | DNET_FLAGS_NOLOCK);
+		wcmd.trans = cmd->trans;
+		wcmd.size = sizeof(struct dnet_io_attr) + io.size;
+
+		err = dnet_process_cmd_raw(n->st, &wcmd, data);
+
+		wcmd.status = err;
+		wcmd.flags = cmd->flags & ~DNET_FLAGS_NEED_ACK;
+		dnet_send_reply(orig, &wcmd, NULL, 0, 1);
+
+		data += sizeof(struct dnet_io_attr) + io.size;
+		size -= sizeof(struct dnet_io_attr) + io.size;
+		num++;
+	}
+
+	dnet_log(n, DNET_LOG_INFO, "%s: bulk write: processed %d entries\n", dnet_dump_id(&cmd->id), num);
+	return 0;
+}
+
 int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
 {
 	int err = 0;
@@ -532,6 +616,10 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 	struct timeval start, end;
 	long diff;
 
+	/* every object of the bulk write is locked separately */
+	if (cmd->cmd == DNET_CMD_BULK_WRITE)
+		cmd->flags |= DNET_FLAGS_NOLOCK;
+
 	if (!(cmd->flags & DNET_FLAGS_NOLOCK)) {
 		dnet_oplock(n, &cmd->id);
 	}
@@ -587,6 +675,12 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 					err = dnet_db_list(st, cmd);
 			}
 			break;
+		case DNET_CMD_BULK_WRITE:
+			if (n->ro)
+				err = -EROFS;
+			else
+				err = dnet_cmd_bulk_write(st, cmd, data);
+			break;
 		case DNET_CMD_READ:
 		case DNET_CMD_WRITE:
 		case DNET_CMD_DEL:
@@ -685,7 +779,8 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 			dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), tid,
 			(unsigned long long)cmd->flags, diff, err);
 
-	if (cmd->flags & DNET_FLAGS_NEED_ACK) {
+	/* commands processed on behalf of node's own state (like bulk write entries) are not acked */
+	if ((cmd->flags & DNET_FLAGS_NEED_ACK) && (st != n->st)) {
 		struct dnet_cmd ack;
 
 		memcpy(&ack.id, &cmd->id, sizeof(struct dnet_id));
@@ -846,14 +941,13 @@ err_out_exit:
 	return err;
 }
 
-int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
-		int fd, uint64_t offset, int close_on_exit)
+static int __dnet_send_read_data(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_io_attr *io,
+		void *data, struct dnet_io_buf *buf, int fd, uint64_t offset, int close_on_exit)
 {
-	struct dnet_net_state *st = state;
+	struct dnet_io_req *r;
 	struct dnet_cmd *c;
 	struct dnet_io_attr *rio;
 	int hsize = sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr);
-	int err;
 
 	/*
 	 * A simple hack to forbid read reply sending.
@@ -864,12 +958,15 @@ int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *
 	if (io->flags & DNET_IO_FLAGS_SKIP_SENDING)
 		return 0;
 
-	c = malloc(hsize);
-	if (!c) {
-		err = -ENOMEM;
-		goto err_out_exit;
-	}
+	/*
+	 * Header and copied data live in the request itself,
+	 * referenced buffer is attached as is.
+	 */
+	r = dnet_io_req_alloc(hsize, (data && !buf) ? io->size : 0);
+	if (!r)
+		return -ENOMEM;
 
+	c = r->header;
 	memset(c, 0, hsize);
 
 	rio = (struct dnet_io_attr *)(c + 1);
@@ -893,15 +990,39 @@ int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *
 	dnet_convert_cmd(c);
 	dnet_convert_io_attr(rio);
 
-	if (data)
-		err = dnet_send_data(st, c, hsize, data, io->size);
-	else
-		err = dnet_send_fd(st, c, hsize, fd, offset, io->size, close_on_exit);
+	if (buf) {
+		if (io->size) {
+			r->data = data;
+			r->dsize = io->size;
+			r->buf = dnet_io_buf_get(buf);
+		}
+	} else if (data) {
+		if (io->size)
+			memcpy(r->data, data, io->size);
+	} else if (fd >= 0 && io->size) {
+		r->fd = fd;
+		r->close_on_exit = close_on_exit;
+		r->local_offset = offset;
+		r->fsize = io->size;
+	}
 
-	free(c);
+	dnet_io_req_enqueue(st, r);
+	return 0;
+}
 
-err_out_exit:
-	return err;
+int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
+		int fd, uint64_t offset, int close_on_exit)
+{
+	return __dnet_send_read_data(state, cmd, io, data, NULL, fd, offset, close_on_exit);
+}
+
+int dnet_send_read_data_buf(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io,
+		struct dnet_io_buf *buf, uint64_t offset)
+{
+	if (offset > buf->size || io->size > buf->size - offset)
+		return -EINVAL;
+
+	return __dnet_send_read_data(state, cmd, io, buf->data + offset, buf, -1, 0, 0);
 }
 
 void dnet_fill_addr_attr(struct dnet_node *n, struct dnet_addr_attr *attr)
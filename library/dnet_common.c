@@ -59,6 +59,7 @@ static char *dnet_cmd_strings[] = {
 	[DNET_CMD_DEL_RANGE] = "DEL_RANGE",
 	[DNET_CMD_AUTH] = "AUTH",
 	[DNET_CMD_BULK_READ] = "BULK_READ",
+	[DNET_CMD_BULK_WRITE] = "BULK_WRITE",
 	[DNET_CMD_UNKNOWN] = "UNKNOWN",
 };
 
@@ -89,6 +90,22 @@ static char *dnet_counter_strings[] = {
 	[DNET_CNTR_DBR_ERROR] = "DNET_CNTR_DBR_ERROR",
 	[DNET_CNTR_DBW_SYSTEM] = "DNET_CNTR_DBW_SYSTEM",
 	[DNET_CNTR_DBW_ERROR] = "DNET_CNTR_DBW_ERROR",
+	[DNET_CNTR_RCV_POOL_HIT] = "DNET_CNTR_RCV_POOL_HIT",
+	[DNET_CNTR_RCV_POOL_MISS] = "DNET_CNTR_RCV_POOL_MISS",
+	[DNET_CNTR_IO_QUEUE] = "DNET_CNTR_IO_QUEUE",
+	[DNET_CNTR_IO_ACTIVE] = "DNET_CNTR_IO_ACTIVE",
+	[DNET_CNTR_IO_THREADS] = "DNET_CNTR_IO_THREADS",
+	[DNET_CNTR_IO_WAIT_TIME] = "DNET_CNTR_IO_WAIT_TIME",
+	[DNET_CNTR_IO_HANDLE_TIME] = "DNET_CNTR_IO_HANDLE_TIME",
+	[DNET_CNTR_NB_IO_QUEUE] = "DNET_CNTR_NB_IO_QUEUE",
+	[DNET_CNTR_NB_IO_ACTIVE] = "DNET_CNTR_NB_IO_ACTIVE",
+	[DNET_CNTR_NB_IO_THREADS] = "DNET_CNTR_NB_IO_THREADS",
+	[DNET_CNTR_NB_IO_WAIT_TIME] = "DNET_CNTR_NB_IO_WAIT_TIME",
+	[DNET_CNTR_NB_IO_HANDLE_TIME] = "DNET_CNTR_NB_IO_HANDLE_TIME",
+	[DNET_CNTR_SEND_QUEUE_SIZE] = "DNET_CNTR_SEND_QUEUE_SIZE",
+	[DNET_CNTR_SEND_THROTTLED] = "DNET_CNTR_SEND_THROTTLED",
+	[DNET_CNTR_SEND_THROTTLE_NUM] = "DNET_CNTR_SEND_THROTTLE_NUM",
+	[DNET_CNTR_WRITE_LATE] = "DNET_CNTR_WRITE_LATE",
 	[DNET_CNTR_UNKNOWN] = "UNKNOWN",
 };
 
@@ -405,6 +422,10 @@ struct dnet_write_completion {
 	void			*reply;
 	int			size;
 	struct dnet_wait	*wait;
+	/* number of groups which acknowledged the write */
+	int			success;
+	/* caller does not wait anymore, replies are only logged and counted */
+	int			detached;
 };
 
 static void dnet_write_complete_free(struct dnet_write_completion *wc)
@@ -421,6 +442,7 @@ static int dnet_write_complete(struct dnet_net_state *st, struct dnet_cmd *cmd,
 	int err = -EINVAL;
 	struct dnet_write_completion *wc = priv;
 	struct dnet_wait *w = wc->wait;
+	int last;
 
 	if (is_trans_destroyed(st, cmd)) {
 		dnet_wakeup(w, w->cond++);
@@ -429,6 +451,22 @@ static int dnet_write_complete(struct dnet_net_state *st, struct dnet_cmd *cmd,
 	}
 
 	err = cmd->status;
+	last = !(cmd->flags & DNET_FLAGS_MORE);
+
+	pthread_mutex_lock(&w->wait_lock);
+	if (wc->detached) {
+		pthread_mutex_unlock(&w->wait_lock);
+
+		if (last) {
+			int level = err ? DNET_LOG_ERROR : DNET_LOG_NOTICE;
+
+			dnet_log(st->n, level, "%s: %s: write completed after quorum: %d\n",
+					dnet_dump_id(&cmd->id), dnet_state_dump_addr(st), err);
+			dnet_counter_inc(st->n, DNET_CNTR_WRITE_LATE, err);
+		}
+		return 0;
+	}
+
 	if (!err && st && (cmd->size > sizeof(struct dnet_addr_attr) + sizeof(struct dnet_file_info))) {
 		int old_size = wc->size;
 		void *data;
@@ -437,7 +475,7 @@ static int dnet_write_complete(struct dnet_net_state *st, struct dnet_cmd *cmd,
 		wc->reply = realloc(wc->reply, wc->size);
 		if (!wc->reply) {
 			err = -ENOMEM;
-			goto err_out_exit;
+			goto err_out_unlock;
 		}
 
 		data = wc->reply + old_size;
@@ -447,16 +485,22 @@ static int dnet_write_complete(struct dnet_net_state *st, struct dnet_cmd *cmd,
 		memcpy(data + sizeof(struct dnet_addr) + sizeof(struct dnet_cmd), cmd + 1, cmd->size);
 	}
 
-err_out_exit:
-	pthread_mutex_lock(&w->wait_lock);
+err_out_unlock:
 	if (w->status < 0)
 		w->status = err;
+	if (!err && last) {
+		wc->success++;
+		pthread_cond_broadcast(&w->wait);
+	}
 	pthread_mutex_unlock(&w->wait_lock);
 
 	return 0;
 }
 
-static struct dnet_trans *dnet_io_trans_create(struct dnet_node *n, struct dnet_io_control *ctl, int *errp)
+/*
+ * Returned transaction is referenced, so that it can be cancelled, caller has to put it.
+ */
+static struct dnet_trans *dnet_io_trans_create_get(struct dnet_node *n, struct dnet_io_control *ctl, int *errp)
 {
 	struct dnet_io_req req;
 	struct dnet_trans *t = NULL;
@@ -537,9 +581,12 @@ static struct dnet_trans *dnet_io_trans_create(struct dnet_node *n, struct dnet_
 		req.dsize = size;
 	}
 
+	dnet_trans_get(t);
 	err = dnet_trans_send(t, &req);
-	if (err)
+	if (err) {
+		dnet_trans_put(t);
 		goto err_out_destroy;
+	}
 
 	return t;
 
@@ -555,21 +602,34 @@ err_out_destroy:
 	return NULL;
 }
 
+static int dnet_io_trans_create(struct dnet_node *n, struct dnet_io_control *ctl)
+{
+	struct dnet_trans *t;
+	int err;
+
+	t = dnet_io_trans_create_get(n, ctl, &err);
+	if (!t)
+		return err;
+
+	dnet_trans_put(t);
+	return 0;
+}
+
 int dnet_trans_create_send_all(struct dnet_node *n, struct dnet_io_control *ctl)
 {
-	int num = 0, i, err;
+	int num = 0, i;
 
 	pthread_mutex_lock(&n->group_lock);
 	for (i=0; i<n->group_num; ++i) {
 		ctl->id.group_id = n->groups[i];
 
-		dnet_io_trans_create(n, ctl, &err);
+		dnet_io_trans_create(n, ctl);
 		num++;
 	}
 	pthread_mutex_unlock(&n->group_lock);
 
 	if (!num) {
-		dnet_io_trans_create(n, ctl, &err);
+		dnet_io_trans_create(n, ctl);
 		num++;
 	}
 
@@ -797,12 +857,7 @@ err_out_exit_no_log:
 
 int dnet_read_object(struct dnet_node *n, struct dnet_io_control *ctl)
 {
-	int err;
-
-	if (!dnet_io_trans_create(n, ctl, &err))
-		return err;
-
-	return 0;
+	return dnet_io_trans_create(n, ctl);
 }
 
 static int dnet_read_file_raw_exec(struct dnet_node *n, const char *file, unsigned int len,
@@ -1953,12 +2008,277 @@ err_out_exit:
 	return data;
 }
 
+/*
+ * Hedged read sends the same read to the next group if the previous one has not replied
+ * within hedged read delay or has failed. The first successful reply wins, transactions
+ * which are still in flight are cancelled.
+ */
+struct dnet_hedged_read;
+
+struct dnet_hedged_read_trans {
+	struct dnet_hedged_read		*hr;
+	struct dnet_trans		*t;
+	void				*data;
+	uint64_t			size;
+	int				status;
+	int				done;
+};
+
+struct dnet_hedged_read {
+	/* @w->cond is the number of completed transactions, @w->wait_lock protects everything below */
+	struct dnet_wait		*w;
+	atomic_t			refcnt;
+	int				winner;
+	int				status;
+
+	int				num;
+	struct dnet_hedged_read_trans	trans[0];
+};
+
+static void dnet_hedged_read_put(struct dnet_hedged_read *hr)
+{
+	int i;
+
+	if (!atomic_dec_and_test(&hr->refcnt))
+		return;
+
+	for (i = 0; i < hr->num; ++i)
+		free(hr->trans[i].data);
+
+	dnet_wait_put(hr->w);
+	free(hr);
+}
+
+/* transaction is done once its last reply is received or it is destroyed without one */
+static void dnet_hedged_read_done(struct dnet_hedged_read_trans *tr, int status)
+{
+	struct dnet_hedged_read *hr = tr->hr;
+	struct dnet_wait *w = hr->w;
+
+	pthread_mutex_lock(&w->wait_lock);
+	if (!tr->done) {
+		if (status && !tr->status)
+			tr->status = status;
+		if (!tr->status && !tr->size)
+			tr->status = -ENOENT;
+
+		tr->done = 1;
+		if (!tr->status && (hr->winner < 0))
+			hr->winner = tr - hr->trans;
+		else if (tr->status)
+			hr->status = tr->status;
+
+		w->cond++;
+		pthread_cond_broadcast(&w->wait);
+	}
+	pthread_mutex_unlock(&w->wait_lock);
+}
+
+static int dnet_hedged_read_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct dnet_hedged_read_trans *tr = priv;
+	struct dnet_hedged_read *hr = tr->hr;
+	struct dnet_io_attr *io;
+	void *data;
+	int err = 0;
+
+	if (is_trans_destroyed(st, cmd)) {
+		dnet_hedged_read_done(tr, cmd ? cmd->status : 0);
+		dnet_hedged_read_put(hr);
+		return 0;
+	}
+
+	/* replies of the same transaction are processed one after another, data is only taken once it is done */
+	if (!cmd->status && (cmd->size >= sizeof(struct dnet_io_attr))) {
+		io = (struct dnet_io_attr *)(cmd + 1);
+
+		dnet_convert_io_attr(io);
+
+		data = realloc(tr->data, tr->size + sizeof(struct dnet_io_attr) + io->size);
+		if (data) {
+			memcpy(data + tr->size, io, sizeof(struct dnet_io_attr) + io->size);
+			tr->data = data;
+			tr->size += sizeof(struct dnet_io_attr) + io->size;
+		} else {
+			err = -ENOMEM;
+		}
+	}
+
+	if (cmd->status || err) {
+		pthread_mutex_lock(&hr->w->wait_lock);
+		if (!tr->status)
+			tr->status = cmd->status ? cmd->status : err;
+		pthread_mutex_unlock(&hr->w->wait_lock);
+	}
+
+	if (!(cmd->flags & DNET_FLAGS_MORE))
+		dnet_hedged_read_done(tr, cmd->status);
+
+	return err;
+}
+
+static long dnet_hedged_read_delay(struct dnet_node *n, struct dnet_id *id)
+{
+	struct dnet_net_state *st;
+	long delay;
+
+	if (n->hedged_read_delay > 0)
+		return n->hedged_read_delay * 1000L;
+
+	st = dnet_state_get_first(n, id);
+	delay = st ? st->median_read_time * 2 : 0;
+	dnet_state_put(st);
+
+	if (delay < DNET_HEDGED_READ_MIN_DELAY)
+		delay = DNET_HEDGED_READ_MIN_DELAY;
+
+	return delay;
+}
+
+static void dnet_hedged_read_deadline(struct timespec *ts, long usecs)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	usecs += tv.tv_usec;
+	ts->tv_sec = tv.tv_sec + usecs / 1000000;
+	ts->tv_nsec = (usecs % 1000000) * 1000;
+}
+
+static void *dnet_read_data_hedged(struct dnet_node *n, struct dnet_id *id, int *groups, int num,
+		struct dnet_io_attr *io, uint64_t cflags, int *errp)
+{
+	struct dnet_hedged_read *hr;
+	struct dnet_hedged_read_trans *tr;
+	struct dnet_io_control ctl;
+	struct dnet_wait *w;
+	struct timespec ts;
+	void *data = NULL;
+	long delay, wait_usecs = n->wait_ts.tv_sec * 1000000L + n->wait_ts.tv_nsec / 1000;
+	int err, i, sent = 0, expired = 1;
+
+	hr = malloc(sizeof(struct dnet_hedged_read) + num * sizeof(struct dnet_hedged_read_trans));
+	if (!hr) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(hr, 0, sizeof(struct dnet_hedged_read) + num * sizeof(struct dnet_hedged_read_trans));
+
+	w = dnet_wait_alloc(0);
+	if (!w) {
+		err = -ENOMEM;
+		free(hr);
+		goto err_out_exit;
+	}
+
+	hr->w = w;
+	hr->winner = -1;
+	hr->status = -ENOENT;
+	hr->num = num;
+	atomic_init(&hr->refcnt, 1);
+
+	memset(&ctl, 0, sizeof(struct dnet_io_control));
+
+	ctl.fd = -1;
+	ctl.complete = dnet_hedged_read_complete;
+
+	ctl.cmd = DNET_CMD_READ;
+	ctl.cflags = DNET_FLAGS_NEED_ACK | cflags;
+
+	memcpy(&ctl.io, io, sizeof(struct dnet_io_attr));
+	memcpy(&ctl.id, id, sizeof(struct dnet_id));
+
+	ctl.id.type = io->type;
+
+	pthread_mutex_lock(&w->wait_lock);
+	while (hr->winner < 0) {
+		/* next group is read when hedge delay expires or when every read sent so far has failed */
+		if ((sent < num) && (expired || (w->cond == sent))) {
+			tr = &hr->trans[sent];
+			tr->hr = hr;
+
+			ctl.id.group_id = groups[sent];
+			ctl.priv = tr;
+
+			atomic_inc(&hr->refcnt);
+			sent++;
+			pthread_mutex_unlock(&w->wait_lock);
+
+			delay = (sent < num) ? dnet_hedged_read_delay(n, &ctl.id) : wait_usecs;
+
+			dnet_log(n, DNET_LOG_NOTICE, "%s: hedged read: group: %d, sent: %d/%d, delay: %ld usecs\n",
+					dnet_dump_id(&ctl.id), ctl.id.group_id, sent, num, delay);
+
+			tr->t = dnet_io_trans_create_get(n, &ctl, &err);
+
+			pthread_mutex_lock(&w->wait_lock);
+			dnet_hedged_read_deadline(&ts, delay);
+			expired = 0;
+			continue;
+		}
+
+		/* every group has failed */
+		if (w->cond == sent)
+			break;
+
+		if (expired) {
+			hr->status = -ETIMEDOUT;
+			break;
+		}
+
+		expired = (pthread_cond_timedwait(&w->wait, &w->wait_lock, &ts) == ETIMEDOUT);
+	}
+
+	if (hr->winner >= 0) {
+		tr = &hr->trans[hr->winner];
+
+		data = tr->data;
+		io->size = tr->size;
+		id->group_id = groups[hr->winner];
+
+		tr->data = NULL;
+		tr->size = 0;
+		err = 0;
+	} else {
+		err = hr->status;
+	}
+	pthread_mutex_unlock(&w->wait_lock);
+
+	for (i = 0; i < sent; ++i) {
+		tr = &hr->trans[i];
+
+		if (!tr->t)
+			continue;
+
+		if (i != hr->winner)
+			dnet_trans_cancel(tr->t);
+		dnet_trans_put(tr->t);
+	}
+
+	if (err) {
+		char id_str[2*DNET_ID_SIZE + 1];
+
+		dnet_log(n, DNET_LOG_ERROR, "%s : hedged read failed: groups: %d: %d\n",
+				dnet_dump_id_len_raw(id->id, DNET_ID_SIZE, id_str), sent, err);
+	}
+
+	dnet_hedged_read_put(hr);
+
+err_out_exit:
+	*errp = err;
+	return data;
+}
+
 void *dnet_read_data_wait_groups(struct dnet_node *n, struct dnet_id *id, int *groups, int num,
 		struct dnet_io_attr *io, uint64_t cflags, int *errp)
 {
 	int i;
 	void *data;
 
+	if (n->hedged_read_delay && (num > 1))
+		return dnet_read_data_hedged(n, id, groups, num, io, cflags, errp);
+
 	for (i = 0; i < num; ++i) {
 		id->group_id = groups[i];
 
@@ -1995,12 +2315,23 @@ err_out_exit:
 	return data;
 }
 
-int dnet_write_data_wait(struct dnet_node *n, struct dnet_io_control *ctl, void **result)
+int dnet_write_data_wait_quorum(struct dnet_node *n, struct dnet_io_control *ctl, void **result, int quorum)
 {
-	int err, trans_num = 0;
+	int err, trans_num = 0, success;
 	struct dnet_wait *w;
 	struct dnet_write_completion *wc;
 
+	/*
+	 * Requests to the slow groups may still be queued when we return, file data is read
+	 * only when they are sent, and caller is free to close @ctl->fd at that point.
+	 */
+	if (quorum > 0 && ctl->fd >= 0) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: quorum write of file data is not supported, fd: %d, quorum: %d\n",
+				dnet_dump_id(&ctl->id), ctl->fd, quorum);
+		err = -EINVAL;
+		goto err_out_exit;
+	}
+
 	wc = malloc(sizeof(struct dnet_write_completion));
 	if (!wc) {
 		err = -ENOMEM;
@@ -2036,7 +2367,14 @@ int dnet_write_data_wait(struct dnet_node *n, struct dnet_io_control *ctl, void
 	 */
 	atomic_sub(&w->refcnt, INT_MAX - trans_num - 1);
 
-	err = dnet_wait_event(w, w->cond == trans_num, &n->wait_ts);
+	err = dnet_wait_event(w, (w->cond == trans_num) || (quorum > 0 && wc->success >= quorum), &n->wait_ts);
+
+	/* transactions which are still in flight complete in background, reply is not touched anymore */
+	pthread_mutex_lock(&w->wait_lock);
+	wc->detached = 1;
+	success = wc->success;
+	pthread_mutex_unlock(&w->wait_lock);
+
 	if (err || w->status) {
 		if (!err)
 			err = w->status;
@@ -2044,6 +2382,12 @@ int dnet_write_data_wait(struct dnet_node *n, struct dnet_io_control *ctl, void
 				dnet_dump_id(&ctl->id), err, w->status);
 	}
 
+	if (!err && (quorum > 0) && (success < quorum)) {
+		err = -EIO;
+		dnet_log(n, DNET_LOG_ERROR, "%s: write quorum is not reached: %d groups out of %d written, %d required.\n",
+				dnet_dump_id(&ctl->id), success, trans_num, quorum);
+	}
+
 	if (err || !trans_num) {
 		if (!err)
 			err = -EINVAL;
@@ -2052,8 +2396,9 @@ int dnet_write_data_wait(struct dnet_node *n, struct dnet_io_control *ctl, void
 	}
 
 	if (trans_num)
-		dnet_log(n, DNET_LOG_NOTICE, "%s: wrote: %llu bytes, type: %d, reply size: %d.\n",
-				dnet_dump_id(&ctl->id), (unsigned long long)ctl->io.size, ctl->io.type, wc->size);
+		dnet_log(n, DNET_LOG_NOTICE, "%s: wrote: %llu bytes, type: %d, groups: %d/%d, reply size: %d.\n",
+				dnet_dump_id(&ctl->id), (unsigned long long)ctl->io.size, ctl->io.type,
+				success, trans_num, wc->size);
 	err = trans_num;
 
 	*result = wc->reply;
@@ -2067,6 +2412,11 @@ err_out_exit:
 	return err;
 }
 
+int dnet_write_data_wait(struct dnet_node *n, struct dnet_io_control *ctl, void **result)
+{
+	return dnet_write_data_wait_quorum(n, ctl, result, 0);
+}
+
 int dnet_lookup_addr(struct dnet_node *n, const void *remote, int len, struct dnet_id *id, int group_id, char *dst, int dlen)
 {
 	struct dnet_id raw;
@@ -2092,37 +2442,46 @@ err_out_exit:
 }
 
 struct dnet_weight {
-	int			weight;
+	double			cost;
 	int			group_id;
 };
 
-static int dnet_weight_compare(const void *v1, const void *v2)
+/*
+ * Expected time state is going to answer the next read in: average response time
+ * multiplied by the number of reads queued before it. Weight is cut down on timeouts
+ * by dnet_trans_check_stall(), so stalling state looks slower than it measured.
+ */
+static double dnet_state_read_cost(struct dnet_net_state *st)
 {
-	const struct dnet_weight *w1 = v1;
-	const struct dnet_weight *w2 = v2;
+	double cost = st->median_read_time;
+
+	if (cost < 1)
+		cost = 1;
+
+	cost *= atomic_read(&st->reads_in_flight) + 1;
+	cost *= (double)DNET_STATE_MAX_WEIGHT / (st->weight > 1 ? st->weight : 1);
 
-	return w2->weight - w1->weight;
+	return cost;
 }
 
+/*
+ * Power of two choices: take two random candidates out of @num and return the one
+ * which is expected to be faster. This keeps requests away from slow replicas without
+ * sending all of them to the single fastest one.
+ */
 static int dnet_weight_get_winner(struct dnet_weight *w, int num)
 {
-	long sum = 0, pos;
-	float r;
-	int i;
-
-	for (i = 0; i < num; ++i)
-		sum += w[i].weight;
+	int i1, i2;
 
-	r = (float)rand() / (float)RAND_MAX;
-	pos = r * sum;
+	if (num == 1)
+		return 0;
 
-	for (i = 0; i < num; ++i) {
-		pos -= w[i].weight;
-		if (pos <= 0)
-			return i;
-	}
+	i1 = rand() % num;
+	i2 = rand() % (num - 1);
+	if (i2 >= i1)
+		i2++;
 
-	return num - 1;
+	return (w[i2].cost < w[i1].cost) ? i2 : i1;
 }
 
 int dnet_mix_states(struct dnet_node *n, struct dnet_id *id, int **groupsp)
@@ -2151,7 +2510,7 @@ int dnet_mix_states(struct dnet_node *n, struct dnet_id *id, int **groupsp)
 
 	if (n->flags & DNET_CFG_RANDOMIZE_STATES) {
 		for (i = 0; i < group_num; ++i) {
-			weights[i].weight = rand();
+			weights[i].cost = rand();
 			weights[i].group_id = groups[i];
 		}
 		num = group_num;
@@ -2168,7 +2527,7 @@ int dnet_mix_states(struct dnet_node *n, struct dnet_id *id, int **groupsp)
 
 			st = dnet_state_get_first(n, id);
 			if (st) {
-				weights[num].weight = (int)st->weight;
+				weights[num].cost = dnet_state_read_cost(st);
 				weights[num].group_id = id->group_id;
 
 				dnet_state_put(st);
@@ -2179,16 +2538,12 @@ int dnet_mix_states(struct dnet_node *n, struct dnet_id *id, int **groupsp)
 	}
 
 	group_num = num;
-	if (group_num) {
-		qsort(weights, group_num, sizeof(struct dnet_weight), dnet_weight_compare);
+	for (i = 0; i < group_num; ++i) {
+		int pos = dnet_weight_get_winner(weights, group_num - i);
+		groups[i] = weights[pos].group_id;
 
-		for (i = 0; i < group_num; ++i) {
-			int pos = dnet_weight_get_winner(weights, group_num - i);
-			groups[i] = weights[pos].group_id;
-
-			if (pos < group_num - 1)
-				memmove(&weights[pos], &weights[pos + 1], (group_num - 1 - pos) * sizeof(struct dnet_weight));
-		}
+		if (pos < group_num - 1 - i)
+			memmove(&weights[pos], &weights[pos + 1], (group_num - 1 - i - pos) * sizeof(struct dnet_weight));
 	}
 
 	dnet_node_set_groups(n, groups, group_num);
@@ -2521,6 +2876,7 @@ int dnet_read_latest_prepare(struct dnet_read_latest_prepare *pr)
 
 	ctl->num = pr->group_num;
 	ctl->pos = 0;
+	pr->latest_num = 0;
 
 	for (i = 0; i < pr->group_num; ++i) {
 		pr->id.group_id = pr->group[i];
@@ -2543,6 +2899,9 @@ int dnet_read_latest_prepare(struct dnet_read_latest_prepare *pr)
 	for (i = 0; i < pr->group_num; ++i) {
 		pr->group[i] = ctl->ids[i].id.group_id;
 
+		if (!dnet_file_read_latest_cmp(&ctl->ids[0], &ctl->ids[i]))
+			pr->latest_num++;
+
 		if (group_id == pr->group[i]) {
 			const struct dnet_read_latest_id *id0 = &ctl->ids[0];
 			const struct dnet_read_latest_id *id1 = &ctl->ids[i];
@@ -2570,7 +2929,8 @@ err_out_exit:
 int dnet_read_latest(struct dnet_node *n, struct dnet_id *id, struct dnet_io_attr *io, uint64_t cflags, void **datap)
 {
 	struct dnet_read_latest_prepare pr;
-	int *g, num, err, i;
+	void *data;
+	int *g, num, err;
 
 	if ((int)io->num > n->group_num) {
 		err = -E2BIG;
@@ -2600,17 +2960,18 @@ int dnet_read_latest(struct dnet_node *n, struct dnet_id *id, struct dnet_io_att
 	if (err)
 		goto err_out_free;
 
+	/*
+	 * Groups which have the latest version are read first (hedged read does not
+	 * go outside of them), older versions are only read if all of them have failed.
+	 */
 	err = -ENODATA;
-	for (i = 0; i < pr.group_num; ++i) {
-		void *data;
-		
-		id->group_id = pr.group[i];
-		data = dnet_read_data_wait_raw(n, id, io, DNET_CMD_READ, cflags, &err);
-		if (data) {
-			*datap = data;
-			err = 0;
-			break;
-		}
+	data = dnet_read_data_wait_groups(n, id, pr.group, pr.latest_num, io, cflags, &err);
+	if (!data)
+		data = dnet_read_data_wait_groups(n, id, pr.group + pr.latest_num, pr.group_num - pr.latest_num,
+				io, cflags, &err);
+	if (data) {
+		*datap = data;
+		err = 0;
 	}
 
 err_out_free:
@@ -2673,192 +3034,850 @@ err_out_free:
 
 }
 
-void *dnet_bulk_read_wait_raw(struct dnet_node *n, struct dnet_id *id, struct dnet_io_attr *ios,
-		uint32_t io_num, int cmd, uint64_t cflags, int *errp)
+static int dnet_io_attr_cmp(const void *d1, const void *d2)
+{
+	const struct dnet_io_attr *io1 = d1;
+	const struct dnet_io_attr *io2 = d2;
+
+	return memcmp(io1->id, io2->id, DNET_ID_SIZE);
+} 
+
+int dnet_bulk_read_object(struct dnet_node *n, struct dnet_io_attr *ios, uint32_t io_num, int group_id, uint64_t cflags,
+	int (* complete)(struct dnet_net_state *state, struct dnet_cmd *cmd, void *priv),
+	void *priv)
 {
 	struct dnet_io_control ctl;
-	struct dnet_io_attr io;
-	struct dnet_wait *w;
-	struct dnet_read_data_completion *c;
-	void *data = NULL;
-	int err;
+	struct dnet_id id;
+	struct dnet_net_state *cur, *next;
+	uint32_t i, start;
+	int num = 0, err;
 
-	w = dnet_wait_alloc(0);
-	if (!w) {
-		err = -ENOMEM;
-		goto err_out_exit;
-	}
+	if (!io_num)
+		return 0;
 
-	c = malloc(sizeof(*c));
-	if (!c) {
-		err = -ENOMEM;
-		goto err_out_put;
-	}
+	qsort(ios, io_num, sizeof(struct dnet_io_attr), dnet_io_attr_cmp);
 
-	c->w = w;
-	c->size = 0;
-	c->data = NULL;
-	/* one for completion callback, another for this function */
-	atomic_init(&c->refcnt, 2);
+	dnet_setup_id(&id, group_id, ios[0].id);
+	id.type = ios[0].type;
+
+	cur = dnet_state_get_first(n, &id);
+	if (!cur) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: Can't get state for id\n", dnet_dump_id(&id));
+		return -ENOENT;
+	}
 
 	memset(&ctl, 0, sizeof(struct dnet_io_control));
 
 	ctl.fd = -1;
+	ctl.complete = complete;
+	ctl.priv = priv;
+	ctl.cmd = DNET_CMD_BULK_READ;
+	ctl.cflags = DNET_FLAGS_NEED_ACK | cflags;
 
-	ctl.priv = c;
-	ctl.complete = dnet_read_data_complete;
+	/*
+	 * Sorted ids are split into ranges owned by the same state,
+	 * every range is sent as soon as its end is found and nobody waits for the reply.
+	 */
+	for (start = 0, i = 1; i <= io_num; ++i) {
+		next = NULL;
+		if (i < io_num) {
+			dnet_setup_id(&id, group_id, ios[i].id);
+			id.type = ios[i].type;
+
+			/* id without state goes to the current one, it will not be found there */
+			next = dnet_state_get_first(n, &id);
+			if (!next || (next == cur)) {
+				if (next)
+					dnet_state_put(next);
+				continue;
+			}
+		}
 
-	ctl.cmd = cmd;
-	ctl.cflags = DNET_FLAGS_NEED_ACK | cflags;
+		dnet_setup_id(&ctl.id, group_id, ios[start].id);
+		ctl.id.type = ios[start].type;
 
-	memcpy(&ctl.id, id, sizeof(struct dnet_id));
-	memset(&ctl.io, 0, sizeof(struct dnet_io_attr));
+		ctl.io.size = (i - start) * sizeof(struct dnet_io_attr);
+		ctl.data = ios + start;
 
-	memcpy(io.id, id->id, DNET_ID_SIZE);
-	memcpy(io.parent, id->id, DNET_ID_SIZE);
+		dnet_log(n, DNET_LOG_NOTICE, "%s: bulk read: count: %u, addr: %s\n",
+				dnet_dump_id(&ctl.id), i - start, dnet_state_dump_addr(cur));
 
-	ctl.io.size = io_num * sizeof(struct dnet_io_attr);
-	ctl.data = ios;
+		/* completion is called even if transaction was not sent */
+		err = dnet_read_object(n, &ctl);
+		if (err)
+			dnet_log(n, DNET_LOG_ERROR, "%s: failed to send bulk read: %d\n", dnet_dump_id(&ctl.id), err);
+		num++;
 
-	dnet_wait_get(w);
-	err = dnet_read_object(n, &ctl);
-	if (err)
-		goto err_out_put_complete;
+		dnet_state_put(cur);
+		cur = next;
+		start = i;
+	}
 
-	err = dnet_wait_event(w, w->cond, &n->wait_ts);
-	if (err || w->status) {
-		char id_str[2*DNET_ID_SIZE + 1];
-		if (!err)
-			err = w->status;
-		if ((cmd != DNET_CMD_READ_RANGE) || (err != -ENOENT))
-			dnet_log(n, DNET_LOG_ERROR, "%d:%s : failed to read data: %d\n",
-				ctl.id.group_id, dnet_dump_id_len_raw(ctl.id.id, DNET_ID_SIZE, id_str), err);
-		goto err_out_put_complete;
+	return num;
+}
+
+struct dnet_bulk_read_completion {
+	struct dnet_wait		*w;
+	atomic_t			refcnt;
+
+	/* every reply carries single object, so there are at most as many replies as requested ids */
+	struct dnet_range_data		*data;
+	uint32_t			num, max;
+};
+
+static void dnet_bulk_read_completion_put(struct dnet_bulk_read_completion *c)
+{
+	uint32_t i;
+
+	if (!atomic_dec_and_test(&c->refcnt))
+		return;
+
+	if (c->data) {
+		for (i = 0; i < c->num; ++i)
+			free(c->data[i].data);
+		free(c->data);
 	}
-	err = c->size;
-	data = c->data;
 
-err_out_put_complete:
-	if (atomic_dec_and_test(&c->refcnt))
-		free(c);
-err_out_put:
-	dnet_wait_put(w);
+	dnet_wait_put(c->w);
+	free(c);
+}
+
+static int dnet_bulk_read_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct dnet_bulk_read_completion *c = priv;
+	struct dnet_wait *w = c->w;
+	struct dnet_io_attr *io;
+	uint64_t size;
+	void *data;
+
+	if (is_trans_destroyed(st, cmd)) {
+		dnet_wakeup(w, w->cond++);
+		dnet_bulk_read_completion_put(c);
+		return 0;
+	}
+
+	if (cmd->status) {
+		pthread_mutex_lock(&w->wait_lock);
+		w->status = cmd->status;
+		pthread_mutex_unlock(&w->wait_lock);
+		return cmd->status;
+	}
+
+	if (cmd->size < sizeof(struct dnet_io_attr))
+		return 0;
+
+	io = (struct dnet_io_attr *)(cmd + 1);
+	dnet_convert_io_attr(io);
+
+	size = sizeof(struct dnet_io_attr) + io->size;
+	if (cmd->size < size)
+		return -EINVAL;
+
+	data = malloc(size);
+	if (!data)
+		return -ENOMEM;
+
+	memcpy(data, io, size);
+
+	pthread_mutex_lock(&w->wait_lock);
+	if (c->num < c->max) {
+		c->data[c->num].data = data;
+		c->data[c->num].size = size;
+		c->num++;
+		data = NULL;
+	}
+	pthread_mutex_unlock(&w->wait_lock);
+
+	if (data) {
+		dnet_log(st->n, DNET_LOG_ERROR, "%s: bulk read: dropping unexpected reply\n", dnet_dump_id_str(io->id));
+		free(data);
+	}
+
+	return 0;
+}
+
+/*
+ * Bulk read requests are sent to all nodes at once, single wait covers all of them.
+ * Every received object is returned in its own dnet_range_data entry, *errp is the number of entries.
+ * If waiting times out, objects received so far are returned.
+ */
+struct dnet_range_data *dnet_bulk_read(struct dnet_node *n, struct dnet_io_attr *ios, uint32_t io_num, int group_id, uint64_t cflags, int *errp)
+{
+	struct dnet_bulk_read_completion *c;
+	struct dnet_range_data *ret = NULL;
+	struct dnet_wait *w;
+	int err = 0, num;
+
+	if (!io_num) {
+		*errp = 0;
+		return NULL;
+	}
+
+	c = malloc(sizeof(struct dnet_bulk_read_completion));
+	if (!c) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(c, 0, sizeof(struct dnet_bulk_read_completion));
+
+	c->data = malloc(io_num * sizeof(struct dnet_range_data));
+	if (!c->data) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+	c->max = io_num;
+
+	w = dnet_wait_alloc(0);
+	if (!w) {
+		err = -ENOMEM;
+		goto err_out_free_data;
+	}
+	c->w = w;
+
+	atomic_set(&c->refcnt, INT_MAX);
+	num = dnet_bulk_read_object(n, ios, io_num, group_id, cflags, dnet_bulk_read_complete, c);
+	if (num < 0) {
+		err = num;
+		num = 0;
+	}
+
+	/*
+	 * 1 - the first reference counter we grabbed at allocation time
+	 */
+	atomic_sub(&c->refcnt, INT_MAX - num - 1);
+
+	if (num) {
+		err = dnet_wait_event(w, w->cond == num, &n->wait_ts);
+		if (err)
+			dnet_log(n, DNET_LOG_ERROR, "bulk read: failed to wait for %d transactions, completed: %d: %d\n",
+					num, w->cond, err);
+	}
+
+	/* late replies are dropped, since there is no room for them */
+	pthread_mutex_lock(&w->wait_lock);
+	if (c->num) {
+		ret = c->data;
+		*errp = c->num;
+
+		c->data = NULL;
+		c->num = c->max = 0;
+	} else if (!err) {
+		err = w->status ? w->status : -ENOENT;
+	}
+	pthread_mutex_unlock(&w->wait_lock);
+
+	dnet_bulk_read_completion_put(c);
+
+	if (!ret)
+		*errp = err;
+	return ret;
+
+err_out_free_data:
+	free(c->data);
+err_out_free:
+	free(c);
 err_out_exit:
 	*errp = err;
-	return data;
+	return NULL;
 }
 
+/*
+ * Every object of the bulk write is written into every group, single object in single group is a unit.
+ * Units are sorted by node they are sent to, consecutive units of the same node are packed into
+ * bulk write transactions (together with objects' metadata) and at most @window transactions
+ * are in flight to every node. Next transaction is sent as soon as one of the node's transactions completes.
+ */
+struct dnet_bulk_write_unit {
+	struct dnet_net_state		*st;
+	/* replies are matched against copy of object's id, caller's control may be gone by then */
+	uint8_t				id[DNET_ID_SIZE];
+	int				index;
+	int				group_id;
+	int				pending;
+	int				status;
+};
+
+struct dnet_bulk_write_node {
+	struct dnet_net_state		*st;
+	int				start, end, pos;
+	int				inflight, sending;
+};
 
-static int dnet_io_attr_cmp(const void *d1, const void *d2)
+struct dnet_bulk_write_ctl {
+	struct dnet_node		*n;
+	atomic_t			refcnt;
+
+	/* @w->cond is the number of completed units, @w->wait_lock protects everything below */
+	struct dnet_wait		*w;
+
+	struct dnet_io_control		*ctl;
+	struct dnet_meta_container	*meta;
+	int				*status;
+	int				ctl_num;
+
+	struct dnet_bulk_write_unit	*units;
+	int				unit_num;
+	struct dnet_bulk_write_node	*nodes;
+	int				node_num;
+
+	int				window;
+	int				stop;
+
+	int				need_reply;
+	void				*reply;
+	int				reply_size;
+};
+
+struct dnet_bulk_write_batch {
+	struct dnet_bulk_write_ctl	*bw;
+	struct dnet_bulk_write_node	*node;
+	int				start, end;
+};
+
+static void dnet_bulk_write_put(struct dnet_bulk_write_ctl *bw)
 {
-	const struct dnet_io_attr *io1 = d1;
-	const struct dnet_io_attr *io2 = d2;
+	int i;
 
-	return memcmp(io1->id, io2->id, DNET_ID_SIZE);
-} 
+	if (!atomic_dec_and_test(&bw->refcnt))
+		return;
 
-struct dnet_range_data *dnet_bulk_read(struct dnet_node *n, struct dnet_io_attr *ios, uint32_t io_num, int group_id, uint64_t cflags, int *errp)
+	if (bw->units) {
+		for (i = 0; i < bw->unit_num; ++i)
+			dnet_state_put(bw->units[i].st);
+	}
+
+	if (bw->meta) {
+		for (i = 0; i < bw->ctl_num; ++i)
+			free(bw->meta[i].data);
+		free(bw->meta);
+	}
+
+	dnet_wait_destroy(bw->w);
+	free(bw->nodes);
+	free(bw->units);
+	free(bw->status);
+	free(bw->reply);
+	free(bw);
+}
+
+/* object is written if at least one of its copies is written, otherwise the last error is reported */
+static void dnet_bulk_write_unit_status(struct dnet_bulk_write_ctl *bw, struct dnet_bulk_write_unit *u, int err)
 {
-	struct dnet_id id, next_id;
-	int ret_num;
-	struct dnet_range_data *ret;
-	struct dnet_net_state *cur, *next = NULL;
+	int *status = &bw->status[u->index];
+
+	u->pending = 0;
+	if (!u->status)
+		u->status = err;
+
+	if (!u->status)
+		*status = 0;
+	else if (*status < 0)
+		*status = u->status;
+}
+
+static int dnet_bulk_write_batch_end(struct dnet_bulk_write_ctl *bw, int start, int end)
+{
+	struct dnet_bulk_write_unit *u;
 	uint64_t size = 0;
-	void *data;
-	int err;
-	uint32_t i, start = -1;
+	int i;
+
+	for (i = start; (i < end) && (i - start < DNET_BULK_WRITE_BATCH_NUM); ++i) {
+		u = &bw->units[i];
+
+		size += sizeof(struct dnet_io_attr) + bw->ctl[u->index].io.size;
+		if (bw->meta[u->index].size)
+			size += sizeof(struct dnet_io_attr) + bw->meta[u->index].size;
 
-	if (io_num <= 0) {
+		if (size >= DNET_BULK_WRITE_BATCH_SIZE)
+			return i + 1;
+	}
+
+	return i;
+}
+
+static void dnet_bulk_write_pump(struct dnet_bulk_write_ctl *bw, struct dnet_bulk_write_node *bn);
+
+static void dnet_bulk_write_finish(struct dnet_bulk_write_ctl *bw, struct dnet_bulk_write_node *bn, int start, int end, int err)
+{
+	struct dnet_wait *w = bw->w;
+	int i;
+
+	pthread_mutex_lock(&w->wait_lock);
+	for (i = start; i < end; ++i) {
+		if (bw->units[i].pending)
+			dnet_bulk_write_unit_status(bw, &bw->units[i], err);
+	}
+
+	bn->inflight--;
+	w->cond += end - start;
+	pthread_cond_broadcast(&w->wait);
+	pthread_mutex_unlock(&w->wait_lock);
+
+	dnet_bulk_write_pump(bw, bn);
+	dnet_bulk_write_put(bw);
+}
+
+static int dnet_bulk_write_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct dnet_bulk_write_batch *b = priv;
+	struct dnet_bulk_write_ctl *bw = b->bw;
+	struct dnet_bulk_write_unit *u;
+	int i, err, old_size;
+
+	if (is_trans_destroyed(st, cmd)) {
+		/* units which were not replied to are failed with transaction status */
+		err = (cmd && cmd->status) ? cmd->status : -EIO;
+
+		dnet_bulk_write_finish(bw, b->node, b->start, b->end, err);
+		free(b);
 		return 0;
 	}
 
-	qsort(ios, io_num, sizeof(struct dnet_io_attr), dnet_io_attr_cmp);
+	/* the final ack, its status is used in destruction completion */
+	if (cmd->cmd != DNET_CMD_WRITE)
+		return 0;
 
-	ret = NULL;
-	ret_num = 0;
-	size = 0;
+	pthread_mutex_lock(&bw->w->wait_lock);
+	for (i = b->start; i < b->end; ++i) {
+		u = &bw->units[i];
 
-	dnet_setup_id(&id, group_id, ios[0].id);
-	id.type = ios[0].type;
+		if (!u->pending || memcmp(u->id, cmd->id.id, DNET_ID_SIZE))
+			continue;
 
-	cur = dnet_state_get_first(n, &id);
-	if (!cur) {
-		dnet_log(n, DNET_LOG_ERROR, "%s: Can't get state for id\n", dnet_dump_id(&id));
-		err = -ENOENT;
-		goto err_out_exit;
+		if (cmd->status && !u->status)
+			u->status = cmd->status;
+
+		/* metadata entry precedes data one, so unit's status is reported once its data is written */
+		if (--u->pending)
+			break;
+
+		dnet_bulk_write_unit_status(bw, u, 0);
+
+		if (bw->need_reply) {
+			old_size = bw->reply_size;
+
+			bw->reply = realloc(bw->reply, old_size + sizeof(struct dnet_addr) + sizeof(struct dnet_cmd));
+			if (bw->reply) {
+				memcpy(bw->reply + old_size, &st->addr, sizeof(struct dnet_addr));
+				memcpy(bw->reply + old_size + sizeof(struct dnet_addr), cmd, sizeof(struct dnet_cmd));
+				bw->reply_size += sizeof(struct dnet_addr) + sizeof(struct dnet_cmd);
+			} else {
+				bw->reply_size = 0;
+			}
+		}
+		break;
+	}
+	pthread_mutex_unlock(&bw->w->wait_lock);
+
+	if (i == b->end)
+		dnet_log(bw->n, DNET_LOG_ERROR, "%s: bulk write: unexpected reply, status: %d\n",
+				dnet_dump_id(&cmd->id), cmd->status);
+
+	return 0;
+}
+
+static void dnet_bulk_write_send(struct dnet_bulk_write_ctl *bw, struct dnet_bulk_write_node *bn, int start, int end)
+{
+	struct dnet_node *n = bw->n;
+	struct dnet_bulk_write_batch *b;
+	struct dnet_bulk_write_unit *u;
+	struct dnet_io_control *ctl;
+	struct dnet_io_attr *io;
+	struct dnet_cmd *cmd;
+	struct dnet_trans *t;
+	struct dnet_io_req req;
+	struct dnet_io_buf *buf;
+	uint64_t size = 0;
+	void *data;
+	int i, err;
+
+	b = malloc(sizeof(struct dnet_bulk_write_batch));
+	if (!b) {
+		err = -ENOMEM;
+		goto err_out_finish;
+	}
+	b->bw = bw;
+	b->node = bn;
+	b->start = start;
+	b->end = end;
+
+	for (i = start; i < end; ++i) {
+		ctl = &bw->ctl[bw->units[i].index];
+
+		if (bw->meta[bw->units[i].index].size)
+			size += sizeof(struct dnet_io_attr) + bw->meta[bw->units[i].index].size;
+
+		size += sizeof(struct dnet_io_attr) + ctl->io.size;
+	}
+
+	/* objects are copied into the batch once, send queue takes a reference to it */
+	buf = dnet_io_buf_alloc(size);
+	if (!buf) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+
+	t = dnet_trans_alloc(n, sizeof(struct dnet_cmd));
+	if (!t) {
+		err = -ENOMEM;
+		goto err_out_put_buf;
+	}
+	t->complete = dnet_bulk_write_complete;
+	t->priv = b;
+
+	cmd = (struct dnet_cmd *)(t + 1);
+	data = dnet_io_buf_data(buf);
+
+	for (i = start; i < end; ++i) {
+		u = &bw->units[i];
+		ctl = &bw->ctl[u->index];
+
+		if (bw->meta[u->index].size) {
+			io = data;
+			memset(io, 0, sizeof(struct dnet_io_attr));
+
+			memcpy(io->id, ctl->id.id, DNET_ID_SIZE);
+			memcpy(io->parent, ctl->id.id, DNET_ID_SIZE);
+			io->type = EBLOB_TYPE_META;
+			io->flags = DNET_IO_FLAGS_META;
+			io->size = bw->meta[u->index].size;
+
+			memcpy(io + 1, bw->meta[u->index].data, io->size);
+			data += sizeof(struct dnet_io_attr) + io->size;
+
+			dnet_convert_io_attr(io);
+		}
+
+		io = data;
+		memcpy(io, &ctl->io, sizeof(struct dnet_io_attr));
+		data += sizeof(struct dnet_io_attr);
+
+		memcpy(data, ctl->data, ctl->io.size);
+		data += ctl->io.size;
+
+		dnet_convert_io_attr(io);
 	}
 
-	for (i = 0; i < io_num; ++i) {
-		if ((i + 1) < io_num) {
-			dnet_setup_id(&next_id, group_id, ios[i+1].id);
-			next_id.type = ios[i+1].type;
+	ctl = &bw->ctl[bw->units[start].index];
+
+	memcpy(&cmd->id, &ctl->id, sizeof(struct dnet_id));
+	cmd->id.group_id = bw->units[start].group_id;
+	cmd->size = size;
+	cmd->flags = ctl->cflags | DNET_FLAGS_NEED_ACK;
+	cmd->status = 0;
+	cmd->cmd = t->command = DNET_CMD_BULK_WRITE;
+	cmd->trans = t->rcv_trans = t->trans = atomic_inc(&n->trans);
+
+	memcpy(&t->cmd, cmd, sizeof(struct dnet_cmd));
+	t->st = dnet_state_get(bn->st);
+
+	dnet_log(n, DNET_LOG_INFO, "%s: created trans: %llu, cmd: %s, objects: %d, size: %llu -> %s\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)t->trans, dnet_cmd_string(cmd->cmd),
+			end - start, (unsigned long long)cmd->size, dnet_server_convert_dnet_addr(&t->st->addr));
+
+	dnet_convert_cmd(cmd);
+
+	memset(&req, 0, sizeof(req));
+	req.st = t->st;
+	req.header = cmd;
+	req.hsize = sizeof(struct dnet_cmd);
+	req.data = dnet_io_buf_data(buf);
+	req.dsize = size;
+	req.buf = buf;
+	req.fd = -1;
+
+	/* failed transaction is completed by destruction completion, which also sends the next one */
+	err = dnet_trans_send(t, &req);
+	if (err)
+		dnet_trans_put(t);
+	dnet_io_buf_put(buf);
+	return;
+
+err_out_put_buf:
+	dnet_io_buf_put(buf);
+err_out_free:
+	free(b);
+err_out_finish:
+	dnet_log(n, DNET_LOG_ERROR, "%s: bulk write: failed to send %d objects: %d\n",
+			dnet_state_dump_addr(bn->st), end - start, err);
+	dnet_bulk_write_finish(bw, bn, start, end, err);
+}
+
+static void dnet_bulk_write_pump(struct dnet_bulk_write_ctl *bw, struct dnet_bulk_write_node *bn)
+{
+	struct dnet_wait *w = bw->w;
+	int start, end;
+
+	pthread_mutex_lock(&w->wait_lock);
+
+	/* completion can be invoked from within send, it must not recurse into the next send */
+	if (bn->sending) {
+		pthread_mutex_unlock(&w->wait_lock);
+		return;
+	}
+	bn->sending = 1;
+
+	while (!bw->stop && (bn->inflight < bw->window) && (bn->pos < bn->end)) {
+		start = bn->pos;
+		end = dnet_bulk_write_batch_end(bw, start, bn->end);
+
+		bn->pos = end;
+		bn->inflight++;
+		atomic_inc(&bw->refcnt);
+
+		pthread_mutex_unlock(&w->wait_lock);
+		dnet_bulk_write_send(bw, bn, start, end);
+		pthread_mutex_lock(&w->wait_lock);
+	}
+
+	bn->sending = 0;
+	pthread_cond_broadcast(&w->wait);
+	pthread_mutex_unlock(&w->wait_lock);
+}
+
+static int dnet_bulk_write_unit_cmp(const void *p1, const void *p2)
+{
+	const struct dnet_bulk_write_unit *u1 = p1;
+	const struct dnet_bulk_write_unit *u2 = p2;
+
+	if (u1->st != u2->st)
+		return ((unsigned long)u1->st < (unsigned long)u2->st) ? -1 : 1;
+
+	return u1->index - u2->index;
+}
+
+static int dnet_bulk_write_setup(struct dnet_bulk_write_ctl *bw, int *groups, int group_num)
+{
+	struct dnet_node *n = bw->n;
+	struct dnet_io_control *ctl;
+	struct dnet_bulk_write_unit *u;
+	struct dnet_metadata_control mcl;
+	struct dnet_id id;
+	struct timeval tv;
+	int i, j, err;
+
+	bw->status = malloc(bw->ctl_num * sizeof(int));
+	bw->units = calloc(bw->unit_num, sizeof(struct dnet_bulk_write_unit));
+	bw->meta = calloc(bw->ctl_num, sizeof(struct dnet_meta_container));
+	if (!bw->status || !bw->units || !bw->meta)
+		return -ENOMEM;
+
+	gettimeofday(&tv, NULL);
+
+	for (i = 0; i < bw->ctl_num; ++i) {
+		ctl = &bw->ctl[i];
+		bw->status[i] = -ENOENT;
+
+		memcpy(ctl->io.id, ctl->id.id, DNET_ID_SIZE);
+		memcpy(ctl->io.parent, ctl->id.id, DNET_ID_SIZE);
+
+		/* do not write metadata for cache-only writes */
+		if (!(ctl->io.flags & DNET_IO_FLAGS_CACHE_ONLY)) {
+			memset(&mcl, 0, sizeof(mcl));
+
+			mcl.groups = groups;
+			mcl.group_num = groups ? group_num : 0;
+			mcl.id = ctl->id;
+			mcl.ts.tv_sec = tv.tv_sec;
+			mcl.ts.tv_nsec = tv.tv_usec * 1000;
 
-			next = dnet_state_get_first(n, &next_id);
-			if (!next) {
-				dnet_log(n, DNET_LOG_ERROR, "%s: Can't get state for id\n", dnet_dump_id(&next_id));
-				err = -ENOENT;
-				goto err_out_put;
+			err = dnet_create_metadata(n, &mcl, &bw->meta[i]);
+			if (err) {
+				dnet_log(n, DNET_LOG_ERROR, "%s: bulk write: failed to create metadata: %d\n",
+						dnet_dump_id(&ctl->id), err);
+				bw->meta[i].size = 0;
+			} else {
+				dnet_convert_metadata(n, bw->meta[i].data, bw->meta[i].size);
 			}
+		}
+
+		for (j = 0; j < group_num; ++j) {
+			u = &bw->units[i * group_num + j];
 
-			/* Send command only if state changes or it's a last id */
-			if ((cur == next)) {
-				dnet_state_put(next);
-				next = NULL;
+			id = ctl->id;
+			if (groups)
+				id.group_id = groups[j];
+
+			memcpy(u->id, ctl->id.id, DNET_ID_SIZE);
+			u->index = i;
+			u->group_id = id.group_id;
+			u->pending = 1 + !!bw->meta[i].size;
+
+			/* objects which are not in memory can not be packed */
+			if (ctl->fd >= 0) {
+				u->status = -EINVAL;
 				continue;
 			}
+
+			u->st = dnet_state_get_first(n, &id);
+			if (!u->st)
+				u->status = -ENOENT;
 		}
+	}
 
-		dnet_log(n, DNET_LOG_NOTICE, "start: %s: end: %s, count: %llu, addr: %s\n",
-					dnet_dump_id(&id),
-					dnet_dump_id(&next_id),
-					(unsigned long long)(i - start),
-					dnet_state_dump_addr(cur));
+	qsort(bw->units, bw->unit_num, sizeof(struct dnet_bulk_write_unit), dnet_bulk_write_unit_cmp);
 
-		data = dnet_bulk_read_wait_raw(n, &id, ios, i - start, DNET_CMD_BULK_READ, cflags, &err);
-		if (data) {
-			size = err;
-			err = 0;
+	for (i = 0; i < bw->unit_num; ++i) {
+		if (bw->units[i].st && (!i || (bw->units[i].st != bw->units[i - 1].st)))
+			bw->node_num++;
+	}
 
-				if (!size) {
-					free(data);
-				} else {
-					struct dnet_range_data *new_ret;
+	bw->nodes = calloc(bw->node_num + 1, sizeof(struct dnet_bulk_write_node));
+	if (!bw->nodes)
+		return -ENOMEM;
 
-					ret_num++;
+	for (i = 0, j = -1; i < bw->unit_num; ++i) {
+		u = &bw->units[i];
 
-					new_ret = realloc(ret, ret_num * sizeof(struct dnet_range_data));
-					if (!new_ret) {
-						goto err_out_put;
-					}
+		/* units which can not be sent are completed right away */
+		if (!u->st) {
+			dnet_bulk_write_unit_status(bw, u, u->status);
+			bw->w->cond++;
+			continue;
+		}
 
-					ret = new_ret;
+		if ((j < 0) || (u->st != bw->nodes[j].st)) {
+			j++;
+			bw->nodes[j].st = u->st;
+			bw->nodes[j].start = bw->nodes[j].pos = i;
+		}
+		bw->nodes[j].end = i + 1;
+	}
 
-					ret[ret_num - 1].data = data;
-					ret[ret_num - 1].size = size;
-				}
+	return 0;
+}
 
-				err = 0;
+int dnet_bulk_write_status(struct dnet_node *n, struct dnet_io_control *ctl, int ctl_num, int *status,
+		struct dnet_range_data *reply)
+{
+	struct dnet_bulk_write_ctl *bw;
+	struct dnet_bulk_write_node *bn;
+	struct dnet_wait *w;
+	int *groups = NULL;
+	int group_num, i, j, err, completed, written = 0;
+
+	if (reply)
+		memset(reply, 0, sizeof(struct dnet_range_data));
+
+	if (ctl_num <= 0)
+		return 0;
+
+	bw = malloc(sizeof(struct dnet_bulk_write_ctl));
+	if (!bw) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(bw, 0, sizeof(struct dnet_bulk_write_ctl));
+
+	w = dnet_wait_alloc(0);
+	if (!w) {
+		err = -ENOMEM;
+		free(bw);
+		goto err_out_exit;
+	}
+
+	bw->n = n;
+	bw->w = w;
+	bw->ctl = ctl;
+	bw->ctl_num = ctl_num;
+	bw->window = n->bulk_write_window;
+	bw->need_reply = !!reply;
+	atomic_set(&bw->refcnt, 1);
+
+	pthread_mutex_lock(&n->group_lock);
+	group_num = n->group_num;
+	if (group_num) {
+		groups = alloca(group_num * sizeof(int));
+		memcpy(groups, n->groups, group_num * sizeof(int));
+	}
+	pthread_mutex_unlock(&n->group_lock);
+
+	/* without groups every object is written into group its id belongs to */
+	if (!group_num)
+		group_num = 1;
+
+	bw->unit_num = ctl_num * group_num;
+
+	err = dnet_bulk_write_setup(bw, groups, group_num);
+	if (err)
+		goto err_out_put;
+
+	for (i = 0; i < bw->node_num; ++i)
+		dnet_bulk_write_pump(bw, &bw->nodes[i]);
+
+	/* every transaction has its own timeout, so give up only if nothing is completed for the whole wait timeout */
+	do {
+		completed = w->cond;
+		err = dnet_wait_event(w, (w->cond == bw->unit_num) || (w->cond != completed), &n->wait_ts);
+	} while (!err && (w->cond != bw->unit_num));
+
+	pthread_mutex_lock(&w->wait_lock);
+	if (err) {
+		dnet_log(n, DNET_LOG_ERROR, "bulk write: failed to wait for %d units, completed: %d: %d\n",
+				bw->unit_num, w->cond, err);
+
+		bw->stop = 1;
+		for (i = 0; i < bw->node_num; ++i) {
+			bn = &bw->nodes[i];
+
+			for (j = bn->pos; j < bn->end; ++j)
+				dnet_bulk_write_unit_status(bw, &bw->units[j], err);
+			bn->pos = bn->end;
 		}
 
-		dnet_state_put(cur);
-		cur = next;
-		next = NULL;
-		memcpy(&id, &next_id, sizeof(struct dnet_id));
+		/*
+		 * Batch which is being built reads caller's controls, wait for it to be queued.
+		 * Replies to in-flight batches only use units, which are owned by @bw.
+		 */
+		for (i = 0; i < bw->node_num; ++i) {
+			while (bw->nodes[i].sending)
+				pthread_cond_wait(&w->wait, &w->wait_lock);
+		}
+
+		/* units which were sent but not replied to yet are reported as timed out, late replies skip them */
+		for (i = 0; i < bw->node_num; ++i) {
+			bn = &bw->nodes[i];
+
+			for (j = bn->start; j < bn->pos; ++j) {
+				if (bw->units[j].pending)
+					dnet_bulk_write_unit_status(bw, &bw->units[j], err);
+			}
+		}
+	}
+
+	for (i = 0; i < ctl_num; ++i) {
+		if (status)
+			status[i] = bw->status[i];
+		if (!bw->status[i])
+			written++;
+	}
+
+	if (reply) {
+		reply->data = bw->reply;
+		reply->size = bw->reply_size;
+
+		bw->reply = NULL;
+		bw->reply_size = 0;
 	}
+	pthread_mutex_unlock(&w->wait_lock);
+
+	dnet_log(n, DNET_LOG_NOTICE, "bulk write: objects: %d, groups: %d, nodes: %d, written: %d\n",
+			ctl_num, group_num, bw->node_num, written);
+
+	dnet_bulk_write_put(bw);
+	return written;
 
 err_out_put:
-	if (next)
-		dnet_state_put(next);
-	dnet_state_put(cur);
+	dnet_bulk_write_put(bw);
 err_out_exit:
-	if (ret) {
-		*errp = ret_num;
-	} else {
-		*errp = err;
-	}
-	return ret;
+	return err;
 }
 
+/*
+ * Every object and its metadata are sent with separate WRITE commands, so that servers
+ * which do not know DNET_CMD_BULK_WRITE are written too. Concatenated dnet_addr and dnet_cmd
+ * replies are returned, *errp is set to the number of completed transactions or negative error.
+ */
 struct dnet_range_data dnet_bulk_write(struct dnet_node *n, struct dnet_io_control *ctl, int ctl_num, int *errp)
 {
 	int err, i, trans_num = 0, local_trans_num;
@@ -2957,6 +3976,9 @@ struct dnet_range_data dnet_bulk_write(struct dnet_node *n, struct dnet_io_contr
 			if (local_trans_num < 0)
 				local_trans_num = 0;
 
+			/* metadata has been copied into send queue */
+			free(mc.data);
+
 			trans_num += local_trans_num;
 		}
 	}
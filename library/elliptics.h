@@ -40,6 +40,7 @@ typedef unsigned short u_short;
 
 #undef offsetof
 #include "rbtree.h"
+#include "wheel.h"
 
 #include "atomic.h"
 #include "lock.h"
@@ -62,6 +63,16 @@ struct dnet_net_state;
 #define dnet_log(n, level, format, a...) do { if (n->log && (n->log->log_level >= level)) dnet_log_raw(n, level, format, ##a); } while (0)
 #define dnet_log_err(n, f, a...) dnet_log(n, DNET_LOG_ERROR, f ": %s [%d].\n", ##a, strerror(errno), errno)
 
+struct dnet_io_buf {
+	atomic_t		refcnt;
+
+	void			*data;
+	size_t			size;
+
+	void			(* destroy)(void *priv);
+	void			*priv;
+};
+
 struct dnet_io_req {
 	struct list_head	req_entry;
 
@@ -73,6 +84,19 @@ struct dnet_io_req {
 	void			*data;
 	size_t			dsize;
 
+	/* Time request was queued to IO pool */
+	struct timeval		queue_time;
+
+	/* Reference to the buffer @data points to, when it is not copied into request */
+	struct dnet_io_buf	*buf;
+
+	/*
+	 * Receive buffer pool this request was allocated from,
+	 * NULL if it was allocated with plain malloc()
+	 */
+	struct dnet_io_req_pool	*pool;
+	int			pool_class;
+
 	int			close_on_exit;
 	int			fd;
 	off_t			local_offset;
@@ -91,12 +115,63 @@ struct dnet_io_req {
 #define DNET_IO_DROP		(1<<1)
 
 #define DNET_STATE_MAX_WEIGHT		(1024 * 10)
+/* weight of the new sample in the state response time average is 1/2^shift */
+#define DNET_STATE_READ_TIME_SHIFT	3
+
+/*
+ * Per-state table of in-flight transactions.
+ * Transaction ids are taken from monotonically increasing node counter,
+ * so low bits of the id spread them evenly among chained buckets.
+ * Table doubles when number of transactions exceeds number of buckets.
+ */
+#define DNET_TRANS_TABLE_SIZE		64
+
+/* Number of buckets in the node hash of joined states keyed by address */
+#define DNET_STATE_ADDR_HASH_SIZE	1024
+
+struct dnet_trans_table {
+	struct list_head	*buckets;
+	unsigned int		mask;
+	unsigned int		num;
+};
+
+#define DNET_SEND_IOV_MAX	64
+
+enum dnet_uring_send_op {
+	DNET_URING_SEND_NONE = 0,
+	DNET_URING_SEND_MSG,			/* memory parts of queued requests */
+	DNET_URING_SEND_FILE_READ,		/* file part is read into registered buffer */
+	DNET_URING_SEND_FILE,			/* registered buffer is sent */
+};
+
+/*
+ * Send side of io_uring engine. Only network thread which owns the state submits
+ * send operations, at most one is in flight, its completion is stored here
+ * and consumed by dnet_send_list(). @op is reset only when sending stops.
+ */
+struct dnet_uring_send {
+	int			op;
+	int			done;
+	int			res;
+
+	/* number of requests whose memory parts are being sent */
+	int			req_num;
+	struct msghdr		msg;
+	struct iovec		iov[DNET_SEND_IOV_MAX];
+
+	/* registered buffer (-1 if none) and its part which is not yet sent */
+	int			buf;
+	size_t			buf_offset, buf_size;
+};
 
 struct dnet_net_state
 {
 	struct list_head	state_entry;
 	struct list_head	storage_state_entry;
 
+	/* entry in node address hash, hashed while state is in group state list */
+	struct hlist_node	addr_entry;
+
 	struct dnet_node	*n;
 
 	atomic_t		refcnt;
@@ -117,24 +192,66 @@ struct dnet_net_state
 	uint64_t		rcv_end;
 	unsigned int		rcv_flags;
 	void			*rcv_data;
+	struct dnet_io_req_pool	*rcv_pool;
+	/* network thread which serves this state and its NUMA node, -1 if it is not bound */
+	int			net_thread;
+	int			numa_node;
+
+	/* data read from socket, but not yet parsed, lives in [rcv_buf_start, rcv_buf_end) */
+	char			*rcv_buf;
+	size_t			rcv_buf_size;
+	size_t			rcv_buf_start, rcv_buf_end;
 
 	int			epoll_fd;
+
+	/* io_uring engine: ring of the network thread and wanted/in-flight requests */
+	struct dnet_uring	*uring;
+	int			uring_want, uring_armed;
+	struct dnet_uring_send	uring_send;
+
 	size_t			send_offset;
+	/* bytes received and sent by network thread, charged against per-wakeup budget */
+	uint64_t		io_bytes;
 	pthread_mutex_t		send_lock;
 	struct list_head	send_list;
+	/* bytes of memory queued for sending, state is not read while it is throttled */
+	uint64_t		send_queue_size;
+	int			send_throttled;
 
 	pthread_mutex_t		trans_lock;
-	struct rb_root		trans_root;
-	struct list_head	trans_list;
+	struct dnet_trans_table	trans_table;
+	/* transaction timeouts, expired but not yet completed ones are moved to @trans_timeout_list */
+	struct dnet_wheel	trans_wheel;
+	struct list_head	trans_timeout_list;
 
 
 	int			la;
 	unsigned long long	free;
 	float			weight;
+	/*
+	 * Moving average of the read and lookup response time in usecs and number of
+	 * such requests in flight, accounted to the route table state even when
+	 * transaction was sent over one of its stripes.
+	 */
 	long			median_read_time;
+	atomic_t		reads_in_flight;
 
 	struct dnet_idc		*idc;
 
+	/*
+	 * Extra connections to the same node opened next to the route table state,
+	 * which itself is stripe 0. @stripe is the index of the extra connection.
+	 * They are opened by check thread while @stripe_pending is set, @stripe_num
+	 * only grows until the state is destroyed.
+	 */
+	struct dnet_net_state	**stripes;
+	int			stripe_num;
+	int			stripe;
+	int			stripe_pending;
+
+	/* accepted connection is an extra connection of joined server, it is never throttled */
+	int			server_stripe;
+
 	struct dnet_stat_count	stat[__DNET_CMD_MAX];
 };
 
@@ -154,13 +271,24 @@ struct dnet_idc {
 int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id *ids, int id_num);
 void dnet_idc_destroy_nolock(struct dnet_net_state *st);
 
+/* group id array updates, also timed by dnet_cpp_bench */
+int dnet_idc_merge_ids(struct dnet_group *g, struct dnet_state_id *ids, int id_num);
+void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g);
+
 struct dnet_net_state *dnet_state_create(struct dnet_node *n,
 		int group_id, struct dnet_raw_id *ids, int id_num,
 		struct dnet_addr *addr, int s, int *errp, int join,
 		int (* process)(struct dnet_net_state *st, struct epoll_event *ev));
+/* @net_thread is the index of network thread which will serve new state, -1 picks one round-robin */
+struct dnet_net_state *dnet_state_create_thread(struct dnet_node *n,
+		int group_id, struct dnet_raw_id *ids, int id_num,
+		struct dnet_addr *addr, int s, int *errp, int join,
+		int (* process)(struct dnet_net_state *st, struct epoll_event *ev),
+		int net_thread);
 
 void dnet_state_reset(struct dnet_net_state *st);
 void dnet_state_remove_nolock(struct dnet_net_state *st);
+void dnet_state_addr_unhash_nolock(struct dnet_net_state *st);
 
 struct dnet_net_state *dnet_state_search_by_addr(struct dnet_node *n, struct dnet_addr *addr);
 struct dnet_net_state *dnet_state_get_first(struct dnet_node *n, struct dnet_id *id);
@@ -281,6 +409,50 @@ struct dnet_group
 	struct dnet_state_id	*ids;
 };
 
+/*
+ * Immutable copy of the route table, which is used by lookups instead of taking @n->state_lock.
+ * It is rebuilt under @n->state_lock every time ids of some state are added or removed,
+ * holds a reference to every state it points to and is freed by dnet_route_reclaim()
+ * only after all lookups which could have seen it are completed.
+ */
+struct dnet_route_id {
+	struct dnet_raw_id	raw;
+	struct dnet_net_state	*st;
+};
+
+struct dnet_route_group {
+	unsigned int		group_id;
+	int			id_num;
+	struct dnet_route_id	*ids;
+
+	/*
+	 * Search index: the first 8 bytes of every id as big-endian number, laid out
+	 * in Eytzinger (breadth-first) order starting from index 1, so that the top
+	 * levels of the search share cache lines. @pos maps index entries back to @ids.
+	 */
+	uint64_t		*prefix;
+	int			*pos;
+};
+
+struct dnet_route_table {
+	struct dnet_route_table	*next;
+
+	/* sorted by group id */
+	int			group_num;
+	struct dnet_route_group	*groups;
+
+	int			state_num;
+	struct dnet_net_state	**states;
+};
+
+void dnet_route_update_nolock(struct dnet_node *n);
+void dnet_route_reclaim(struct dnet_node *n);
+
+/* snapshot group search index, also timed by dnet_cpp_bench */
+int dnet_route_index_build(struct dnet_route_group *g, struct dnet_state_id *ids, int i, int k);
+int dnet_route_id_search(struct dnet_route_group *g, struct dnet_id *id);
+void dnet_state_stripes_open(struct dnet_node *n);
+
 static inline struct dnet_group *dnet_group_get(struct dnet_group *g)
 {
 	atomic_inc(&g->refcnt);
@@ -305,12 +477,68 @@ struct dnet_transform
 int dnet_crypto_init(struct dnet_node *n, void *ns, int nsize);
 void dnet_crypto_cleanup(struct dnet_node *n);
 
+/*
+ * Receive buffers are allocated by network thread and freed by IO threads,
+ * so every network thread has its own size-classed cache of them.
+ * Network thread allocates from @free lists without locking,
+ * IO threads put released buffers into @returned lists under @lock,
+ * and they are moved back in bulk when @free list becomes empty.
+ * Both lists of the class together hold at most DNET_IO_REQ_POOL_CACHE_SIZE bytes,
+ * @free_num is atomic since IO threads check it against that limit.
+ *
+ * Requests larger than the biggest class are allocated with malloc().
+ */
+#define DNET_IO_REQ_POOL_CLASSES	5
+#define DNET_IO_REQ_POOL_MIN_SIZE	512
+#define DNET_IO_REQ_POOL_CACHE_SIZE	(4 * 1024 * 1024)
+
+struct dnet_io_req_pool {
+	struct list_head	free[DNET_IO_REQ_POOL_CLASSES];
+	atomic_t		free_num[DNET_IO_REQ_POOL_CLASSES];
+
+	pthread_mutex_t		lock;
+	struct list_head	returned[DNET_IO_REQ_POOL_CLASSES];
+	int			returned_num[DNET_IO_REQ_POOL_CLASSES];
+
+	unsigned long long	hit, miss;
+};
+
 struct dnet_net_io {
 	int			epoll_fd;
 	pthread_t		tid;
 	struct dnet_node	*n;
+
+	int			event_num;
+	struct epoll_event	*events;
+	long			*budget;
+
+	struct dnet_io_req_pool	rcv_pool;
+
+	/* CPU thread is bound to and its NUMA node, -1 if thread is not bound */
+	int			cpu, node;
+
+	/* NULL if epoll engine is used */
+	struct dnet_uring	*uring;
 };
 
+#define DNET_URING_RECV		(1<<0)
+#define DNET_URING_SEND		(1<<1)
+
+int dnet_uring_init(struct dnet_net_io *nio);
+void dnet_uring_exit(struct dnet_net_io *nio);
+int dnet_uring_wait(struct dnet_net_io *nio, int carry);
+int dnet_uring_schedule(struct dnet_net_state *st, int bit);
+void dnet_uring_unschedule(struct dnet_net_state *st, int bit);
+void dnet_uring_rearm(struct dnet_net_state *st);
+int dnet_uring_recv_async(struct dnet_net_state *st);
+int dnet_uring_send_async(struct dnet_net_state *st);
+int dnet_uring_send_result(struct dnet_net_state *st, int *res);
+void dnet_uring_send_idle(struct dnet_net_state *st);
+int dnet_uring_sendmsg(struct dnet_net_state *st, int req_num, int iov_num, int flags);
+int dnet_uring_file_read(struct dnet_net_state *st, int fd, uint64_t offset, uint64_t size);
+int dnet_uring_file_send(struct dnet_net_state *st, int flags);
+void dnet_uring_file_release(struct dnet_net_state *st);
+
 enum dnet_work_io_mode {
 	DNET_WORK_IO_MODE_BLOCKING = 0,
 	DNET_WORK_IO_MODE_NONBLOCKING,
@@ -318,22 +546,72 @@ enum dnet_work_io_mode {
 };
 
 struct dnet_work_pool;
+
+/*
+ * Every IO thread owns its request queue and is woken up only
+ * when request is queued to it. Idle thread steals requests
+ * from queues of its busy neighbours before going to sleep.
+ */
 struct dnet_work_io {
 	int			thread_index;
 	pthread_t		tid;
 	struct dnet_work_pool	*pool;
+
+	/* CPU thread is bound to and its NUMA node, -1 if thread is not bound */
+	int			cpu, node;
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		wait;
+	struct list_head	list;
+	int			idle;
+
+	/* thread has left the pool, requests must not be queued here */
+	int			exited;
+	/* thread was started and was not joined yet */
+	int			joinable;
+
+	/*
+	 * Running averages of time requests wait in queue and are processed, usecs,
+	 * only updated by the thread itself, see DNET_WORK_IO_TIME_SHIFT
+	 */
+	long			wait_time, handle_time;
 };
 
+/*
+ * Work pool runs between @min and @max threads, @num threads with the lowest indexes
+ * are running. Pool grows when requests queue up or wait for too long,
+ * and the last thread leaves when it was idle for DNET_WORK_IO_IDLE_EXIT seconds.
+ */
+#define DNET_WORK_IO_IDLE_EXIT		30
+#define DNET_WORK_IO_WAIT_GROW		100000 /* usecs */
+/* weight of the new sample in per-thread running averages is 1/(1 << shift) */
+#define DNET_WORK_IO_TIME_SHIFT		3
+
 struct dnet_work_pool {
 	struct dnet_node	*n;
 	int			mode;
-	int			num;
-	struct list_head	list;
+	int			num, min, max;
+	atomic_t		pos;
+	/* threads are bound to CPUs which belong to different NUMA nodes */
+	int			numa;
+	/* every thread uses queue of the first one, see DNET_CFG_IO_SHARED_QUEUE */
+	int			shared;
+
+	/* serializes starting and stopping threads */
 	pthread_mutex_t		lock;
-	pthread_cond_t		wait;
+	void			*(* process)(void *);
+
+	/* requests in queues and threads which process requests right now */
+	atomic_t		queued, active;
+
 	struct dnet_work_io	wio[0];
 };
 
+struct dnet_work_pool_stat {
+	unsigned long long	queued, active, threads;
+	unsigned long long	wait_time, handle_time;
+};
+
 struct dnet_io {
 	int			need_exit;
 
@@ -347,9 +625,16 @@ struct dnet_io {
 
 int dnet_state_accept_process(struct dnet_net_state *st, struct epoll_event *ev);
 int dnet_state_net_process(struct dnet_net_state *st, struct epoll_event *ev);
+int dnet_state_rcv_buf_alloc(struct dnet_net_state *st);
 int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg);
 void dnet_io_exit(struct dnet_node *n);
 
+void dnet_io_req_pool_put(struct dnet_io_req *r);
+void dnet_io_req_pool_stat(struct dnet_node *n, unsigned long long *hit, unsigned long long *miss);
+void dnet_work_pool_stat(struct dnet_node *n, int nonblocking, struct dnet_work_pool_stat *st);
+
+struct dnet_io_req *dnet_io_req_alloc(size_t hsize, size_t dsize);
+void dnet_io_req_enqueue(struct dnet_net_state *st, struct dnet_io_req *r);
 void dnet_io_req_free(struct dnet_io_req *r);
 
 struct dnet_locks {
@@ -388,6 +673,20 @@ struct dnet_node
 	pthread_mutex_t		state_lock;
 	struct list_head	group_list;
 
+	/* states from all groups hashed by address, protected by @state_lock */
+	struct hlist_head	addr_hash[DNET_STATE_ADDR_HASH_SIZE];
+
+	/*
+	 * Current route table snapshot and those replaced, but not yet freed.
+	 * Lookup registers itself in @route_readers selected by @route_epoch,
+	 * old snapshots are freed once both counters have drained after the switch.
+	 */
+	struct dnet_route_table * volatile route;
+	struct dnet_route_table	*route_retired;
+	atomic_t		route_epoch;
+	atomic_t		route_readers[2];
+	pthread_mutex_t		route_sync_lock;
+
 	/* hosts client states, i.e. those who didn't join network */
 	struct list_head	empty_state_list;
 
@@ -443,6 +742,31 @@ struct dnet_node
 
 	size_t			cache_size;
 	void			*cache;
+
+	size_t			recv_buffer_size;
+
+	/*
+	 * Limits of memory queued for sending to single client connection and to all of them,
+	 * zero disables throttling. Global counter is kept in kilobytes to fit into atomic_t.
+	 */
+	uint64_t		send_queue_limit, send_queue_global_limit;
+	atomic_t		send_queue_kb;
+	atomic_t		send_throttled, send_throttle_num;
+
+	/*
+	 * Number of connections opened to every remote node and size
+	 * of the request which is sent over dedicated (the last) connection.
+	 */
+	int			stripe_num;
+	uint64_t		stripe_large_size;
+	/* number of states whose stripes are not opened yet */
+	atomic_t		stripe_pending;
+
+	/* maximum number of bulk write transactions in flight to single node */
+	int			bulk_write_window;
+
+	/* hedged read delay in milliseconds, negative for adaptive one, zero disables hedged reads */
+	int			hedged_read_delay;
 };
 
 static inline int dnet_counter_init(struct dnet_node *n)
@@ -501,7 +825,7 @@ int dnet_process_recv(struct dnet_net_state *st, struct dnet_io_req *r);
 int dnet_recv(struct dnet_net_state *st, void *data, unsigned int size);
 int dnet_sendfile(struct dnet_net_state *st, int fd, uint64_t *offset, uint64_t size);
 
-int dnet_send_request(struct dnet_net_state *st, struct dnet_io_req *r);
+int dnet_send_list(struct dnet_net_state *st);
 
 struct dnet_config;
 int dnet_socket_create(struct dnet_node *n, struct dnet_config *cfg, struct dnet_addr *addr, int listening);
@@ -520,14 +844,16 @@ int __attribute__((weak)) dnet_state_join_nolock(struct dnet_net_state *st);
 
 struct dnet_trans
 {
-	struct rb_node			trans_entry;
-	struct list_head		trans_list_entry;
+	struct list_head		trans_entry;
+	struct dnet_wheel_timer		timer;
 
-	struct timeval			time, start;
+	struct timeval			start;
 
 	struct dnet_net_state		*orig; /* only for forward */
 
 	struct dnet_net_state		*st;
+	/* state response time of the read or lookup is accounted to */
+	struct dnet_net_state		*rtt_st;
 	uint64_t			trans, rcv_trans;
 	struct dnet_cmd			cmd;
 
@@ -558,10 +884,15 @@ static inline void dnet_trans_put(struct dnet_trans *t)
 		dnet_trans_destroy(t);
 }
 
-int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a);
+int dnet_trans_table_init(struct dnet_trans_table *table, unsigned int size);
+void dnet_trans_table_cleanup(struct dnet_trans_table *table);
+struct dnet_trans *dnet_trans_first_nolock(struct dnet_trans_table *table);
+
+int dnet_trans_insert_nolock(struct dnet_trans_table *table, struct dnet_trans *a);
 void dnet_trans_remove(struct dnet_trans *t);
-void dnet_trans_remove_nolock(struct rb_root *root, struct dnet_trans *t);
-struct dnet_trans *dnet_trans_search(struct rb_root *root, uint64_t trans);
+void dnet_trans_remove_nolock(struct dnet_trans_table *table, struct dnet_trans *t);
+void dnet_trans_cancel(struct dnet_trans *t);
+struct dnet_trans *dnet_trans_search(struct dnet_trans_table *table, uint64_t trans);
 
 int dnet_trans_send(struct dnet_trans *t, struct dnet_io_req *req);
 
@@ -696,6 +1027,11 @@ void dnet_monitor_exit(struct dnet_node *n);
 int dnet_monitor_init(struct dnet_node *n, struct dnet_config *cfg);
 
 int dnet_set_name(char *name);
+
+#define DNET_CPU_MAX		1024
+int dnet_set_cpu(int cpu);
+int dnet_cpu_node(int cpu);
+
 int dnet_ioprio_set(long pid, int class_id, int prio);
 int dnet_ioprio_get(long pid);
 
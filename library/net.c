@@ -16,6 +16,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -124,6 +125,17 @@ int dnet_socket_create_addr(struct dnet_node *n, int sock_type, int proto, int f
 		err = 1;
 		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &err, 4);
 
+		if (n->flags & DNET_CFG_REUSEPORT) {
+			err = setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &err, 4);
+			if (err) {
+				err = -errno;
+				dnet_log_err(n, "Failed to set SO_REUSEPORT on %s:%d",
+					dnet_server_convert_addr(sa, salen),
+					dnet_server_convert_port(sa, salen));
+				goto err_out_close;
+			}
+		}
+
 		err = bind(s, sa, salen);
 		if (err) {
 			err = -errno;
@@ -233,20 +245,16 @@ err_out_exit:
 
 static void dnet_state_clean(struct dnet_net_state *st)
 {
-	struct rb_node *rb_node;
 	struct dnet_trans *t;
 	int num = 0;
 
 	while (1) {
-		t = NULL;
-
 		pthread_mutex_lock(&st->trans_lock);
-		rb_node = rb_first(&st->trans_root);
-		if (rb_node) {
-			t = rb_entry(rb_node, struct dnet_trans, trans_entry);
+		t = dnet_trans_first_nolock(&st->trans_table);
+		if (t) {
 			dnet_trans_get(t);
-			dnet_trans_remove_nolock(&st->trans_root, t);
-			list_del_init(&t->trans_list_entry);
+			dnet_trans_remove_nolock(&st->trans_table, t);
+			dnet_wheel_del(&t->timer);
 		}
 		pthread_mutex_unlock(&st->trans_lock);
 
@@ -261,66 +269,225 @@ static void dnet_state_clean(struct dnet_net_state *st)
 	dnet_log(st->n, DNET_LOG_NOTICE, "Cleaned state %s, transactions freed: %d\n", dnet_state_dump_addr(st), num);
 }
 
+struct dnet_io_buf *dnet_io_buf_wrap(void *data, size_t size, void (* destroy)(void *priv), void *priv)
+{
+	struct dnet_io_buf *buf;
+
+	buf = malloc(sizeof(struct dnet_io_buf));
+	if (!buf)
+		return NULL;
+
+	atomic_init(&buf->refcnt, 1);
+	buf->data = data;
+	buf->size = size;
+	buf->destroy = destroy;
+	buf->priv = priv;
+
+	return buf;
+}
+
+struct dnet_io_buf *dnet_io_buf_alloc(size_t size)
+{
+	struct dnet_io_buf *buf;
+
+	buf = malloc(sizeof(struct dnet_io_buf) + size);
+	if (!buf)
+		return NULL;
+
+	atomic_init(&buf->refcnt, 1);
+	buf->data = buf + 1;
+	buf->size = size;
+	buf->destroy = NULL;
+	buf->priv = NULL;
+
+	return buf;
+}
+
+struct dnet_io_buf *dnet_io_buf_get(struct dnet_io_buf *buf)
+{
+	atomic_inc(&buf->refcnt);
+	return buf;
+}
+
+void dnet_io_buf_put(struct dnet_io_buf *buf)
+{
+	if (atomic_dec_and_test(&buf->refcnt)) {
+		if (buf->destroy)
+			buf->destroy(buf->priv);
+		free(buf);
+	}
+}
+
+void *dnet_io_buf_data(struct dnet_io_buf *buf)
+{
+	return buf->data;
+}
+
+size_t dnet_io_buf_size(struct dnet_io_buf *buf)
+{
+	return buf->size;
+}
+
 /*
- * Eventually we may end up with proper reference counters here, but for now let's just copy the whole buf.
- * Large data blocks are being sent through sendfile anyway, so it should not be _that_ costly operation.
+ * Allocates send request with @hsize bytes of header and @dsize bytes of data placed right after it.
  */
-static int dnet_io_req_queue(struct dnet_net_state *st, struct dnet_io_req *orig)
+struct dnet_io_req *dnet_io_req_alloc(size_t hsize, size_t dsize)
 {
-	void *buf;
 	struct dnet_io_req *r;
-	int offset = 0;
-	int err;
 
-	buf = r = malloc(sizeof(struct dnet_io_req) + orig->dsize + orig->hsize);
-	if (!r) {
-		err = -ENOMEM;
-		goto err_out_exit;
-	}
+	r = malloc(sizeof(struct dnet_io_req) + hsize + dsize);
+	if (!r)
+		return NULL;
+
 	memset(r, 0, sizeof(struct dnet_io_req));
 	r->fd = -1;
 
-	if (orig->header && orig->hsize) {
-		r->header = buf + sizeof(struct dnet_io_req);
-		r->hsize = orig->hsize;
+	if (hsize) {
+		r->header = r + 1;
+		r->hsize = hsize;
+	}
 
-		offset = r->hsize;
-		memcpy(r->header, orig->header, r->hsize);
+	if (dsize) {
+		r->data = (void *)(r + 1) + hsize;
+		r->dsize = dsize;
 	}
 
-	if (orig->data && orig->dsize) {
-		r->data = buf + sizeof(struct dnet_io_req) + offset;
-		r->dsize = orig->dsize;
-		
-		offset += r->dsize;
-		memcpy(r->data, orig->data, r->dsize);
+	return r;
+}
+
+/*
+ * Memory queued for sending is accounted from enqueueing until request is sent.
+ * Server stops reading requests from client connection when its queue exceeds
+ * per-connection limit or when total queued memory exceeds global limit,
+ * and resumes when queue is empty or both are below half of their limits.
+ * Connections from other servers (including their extra connections, which
+ * announce themselves in auth request) are never throttled: two servers which
+ * stop reading each other would deadlock.
+ *
+ * Both helpers are called under @st->send_lock.
+ */
+static inline int dnet_send_queue_kb(uint64_t size)
+{
+	return (size + 1023) >> 10;
+}
+
+static void dnet_send_queue_add(struct dnet_net_state *st, struct dnet_io_req *r)
+{
+	struct dnet_node *n = st->n;
+	uint64_t size = r->hsize + r->dsize;
+
+	st->send_queue_size += size;
+	atomic_add(&n->send_queue_kb, dnet_send_queue_kb(size));
+
+	if (st->send_throttled || !n->send_queue_limit || (st->__join_state == DNET_JOIN) || st->server_stripe)
+		return;
+
+	if ((st->send_queue_size > n->send_queue_limit) ||
+			((uint64_t)atomic_read(&n->send_queue_kb) << 10 > n->send_queue_global_limit)) {
+		st->send_throttled = 1;
+		atomic_inc(&n->send_throttled);
+		atomic_inc(&n->send_throttle_num);
+
+		dnet_unschedule_recv(st);
+
+		dnet_log(n, DNET_LOG_NOTICE, "%s: throttling connection: queued: %llu, total queued: %llu KB\n",
+				dnet_state_dump_addr(st), (unsigned long long)st->send_queue_size,
+				(unsigned long long)atomic_read(&n->send_queue_kb));
 	}
+}
 
-	if (orig->fd >= 0 && orig->fsize) {
-		r->fd = orig->fd;
-		r->close_on_exit = orig->close_on_exit;
-		r->local_offset = orig->local_offset;
-		r->fsize = orig->fsize;
+static void dnet_send_queue_del(struct dnet_net_state *st, struct dnet_io_req *r)
+{
+	struct dnet_node *n = st->n;
+	uint64_t size = r->hsize + r->dsize;
+
+	st->send_queue_size -= size;
+	atomic_sub(&n->send_queue_kb, dnet_send_queue_kb(size));
+
+	if (!st->send_throttled)
+		return;
+
+	if (!st->send_queue_size || ((st->send_queue_size <= n->send_queue_limit / 2) &&
+			((uint64_t)atomic_read(&n->send_queue_kb) << 10 <= n->send_queue_global_limit / 2))) {
+		st->send_throttled = 0;
+		atomic_dec(&n->send_throttled);
+
+		if (!st->need_exit)
+			dnet_schedule_recv(st);
+
+		dnet_log(n, DNET_LOG_NOTICE, "%s: connection is not throttled anymore: queued: %llu, total queued: %llu KB\n",
+				dnet_state_dump_addr(st), (unsigned long long)st->send_queue_size,
+				(unsigned long long)atomic_read(&n->send_queue_kb));
 	}
+}
 
+/*
+ * Puts request allocated with dnet_io_req_alloc() into the send queue,
+ * it will be freed with dnet_io_req_free() when sent.
+ */
+void dnet_io_req_enqueue(struct dnet_net_state *st, struct dnet_io_req *r)
+{
 	pthread_mutex_lock(&st->send_lock);
 	list_add_tail(&r->req_entry, &st->send_list);
+	dnet_send_queue_add(st, r);
 
 	if (!st->need_exit)
 		dnet_schedule_send(st);
 	pthread_mutex_unlock(&st->send_lock);
+}
 
-	return 0;
+/*
+ * Header and in-memory data are copied, since callers may reuse their buffers right after return.
+ * If @orig->buf is set, @orig->data points into it and only a reference is taken instead of copy.
+ */
+static int dnet_io_req_queue(struct dnet_net_state *st, struct dnet_io_req *orig)
+{
+	struct dnet_io_req *r;
+	size_t hsize = 0, dsize = 0;
 
-err_out_exit:
-	return err;
+	if (orig->header && orig->hsize)
+		hsize = orig->hsize;
+	if (orig->data && orig->dsize && !orig->buf)
+		dsize = orig->dsize;
+
+	r = dnet_io_req_alloc(hsize, dsize);
+	if (!r)
+		return -ENOMEM;
+
+	if (hsize)
+		memcpy(r->header, orig->header, hsize);
+
+	if (dsize) {
+		memcpy(r->data, orig->data, dsize);
+	} else if (orig->buf && orig->data && orig->dsize) {
+		r->data = orig->data;
+		r->dsize = orig->dsize;
+		r->buf = dnet_io_buf_get(orig->buf);
+	}
+
+	if (orig->fd >= 0 && orig->fsize) {
+		r->fd = orig->fd;
+		r->close_on_exit = orig->close_on_exit;
+		r->local_offset = orig->local_offset;
+		r->fsize = orig->fsize;
+	}
+
+	dnet_io_req_enqueue(st, r);
+	return 0;
 }
 
 void dnet_io_req_free(struct dnet_io_req *r)
 {
 	if (r->fd >= 0 && r->fsize && r->close_on_exit)
 		close(r->fd);
-	free(r);
+
+	if (r->buf)
+		dnet_io_buf_put(r->buf);
+
+	if (r->pool)
+		dnet_io_req_pool_put(r);
+	else
+		free(r);
 }
 
 static int dnet_wait(struct dnet_net_state *st, unsigned int events, long timeout)
@@ -448,6 +615,7 @@ static ssize_t dnet_send_fd_nolock(struct dnet_net_state *st, int fd, uint64_t o
 
 		dsize -= err;
 		st->send_offset += err;
+		st->io_bytes += err;
 		err = 0;
 	}
 
@@ -472,21 +640,96 @@ ssize_t dnet_send_fd(struct dnet_net_state *st, void *header, uint64_t hsize,
 
 static void dnet_trans_timestamp(struct dnet_net_state *st, struct dnet_trans *t)
 {
-	gettimeofday(&t->time, NULL);
-	t->time.tv_sec += st->n->wait_ts.tv_sec;
+	dnet_wheel_add(&st->trans_wheel, &t->timer,
+			dnet_wheel_ticks() + st->n->wait_ts.tv_sec * 1000 / DNET_WHEEL_TICK_MS);
+}
+
+/*
+ * Only data commands are striped, control ones (join, auth, route list and so on)
+ * always go over the route table state.
+ * Returns number of bytes transaction is going to read or write, or -1 if it is not striped.
+ */
+static int64_t dnet_trans_stripe_size(struct dnet_trans *t, struct dnet_io_req *req)
+{
+	struct dnet_io_attr *io;
+
+	switch (t->command) {
+	case DNET_CMD_READ:
+		if (req->hsize < sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr))
+			return 0;
+
+		/* zero size means whole object of unknown size, it is considered small */
+		io = (struct dnet_io_attr *)((struct dnet_cmd *)req->header + 1);
+		return dnet_bswap64(io->size);
+	case DNET_CMD_BULK_READ:
+		return INT64_MAX;
+	case DNET_CMD_BULK_WRITE:
+	case DNET_CMD_WRITE:
+	case DNET_CMD_LOOKUP:
+	case DNET_CMD_DEL:
+		return req->hsize + req->dsize + req->fsize;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Small requests are spread by transaction number over the state itself and all
+ * stripes but the last one, which is reserved for large transfers.
+ * Stripe which has been reset is not used, its requests fall back to the state.
+ */
+static struct dnet_net_state *dnet_state_stripe(struct dnet_net_state *st, struct dnet_trans *t, int64_t size)
+{
+	struct dnet_net_state *stripe;
+	/* check thread may be adding stripes meanwhile */
+	int num = *(volatile int *)&st->stripe_num;
+	int idx;
+
+	if ((uint64_t)size >= st->n->stripe_large_size)
+		idx = num;
+	else
+		idx = t->trans % num;
+
+	if (!idx)
+		return st;
 
-	list_move_tail(&t->trans_list_entry, &st->trans_list);
+	stripe = st->stripes[idx - 1];
+	if (stripe->need_exit)
+		return st;
+
+	return stripe;
 }
 
 int dnet_trans_send(struct dnet_trans *t, struct dnet_io_req *req)
 {
 	struct dnet_net_state *st = req->st;
+	int64_t size;
 	int err;
 
+	if (!t->rtt_st && ((t->command == DNET_CMD_READ) || (t->command == DNET_CMD_LOOKUP))) {
+		t->rtt_st = dnet_state_get(st);
+		atomic_inc(&st->reads_in_flight);
+	}
+
+	if (st->stripe_num) {
+		size = dnet_trans_stripe_size(t, req);
+		if (size >= 0) {
+			st = dnet_state_stripe(st, t, size);
+			if (st != req->st) {
+				/* reply is searched for in the transaction table of the connection it was received from */
+				if (t->st == req->st) {
+					t->st = dnet_state_get(st);
+					dnet_state_put(req->st);
+				}
+				req->st = st;
+			}
+		}
+	}
+
 	dnet_trans_get(t);
 
 	pthread_mutex_lock(&st->trans_lock);
-	err = dnet_trans_insert_nolock(&st->trans_root, t);
+	err = dnet_trans_insert_nolock(&st->trans_table, t);
 	if (!err)
 		dnet_trans_timestamp(st, t);
 	pthread_mutex_unlock(&st->trans_lock);
@@ -670,11 +913,11 @@ int dnet_process_recv(struct dnet_net_state *st, struct dnet_io_req *r)
 		uint64_t tid = cmd->trans & ~DNET_TRANS_REPLY;
 
 		pthread_mutex_lock(&st->trans_lock);
-		t = dnet_trans_search(&st->trans_root, tid);
+		t = dnet_trans_search(&st->trans_table, tid);
 		if (t) {
 			if (!(cmd->flags & DNET_FLAGS_MORE)) {
-				dnet_trans_remove_nolock(&st->trans_root, t);
-				list_del_init(&t->trans_list_entry);
+				dnet_trans_remove_nolock(&st->trans_table, t);
+				dnet_wheel_del(&t->timer);
 			} else
 				dnet_trans_timestamp(st, t);
 		}
@@ -738,6 +981,7 @@ err_out_exit:
 
 void dnet_state_remove_nolock(struct dnet_net_state *st)
 {
+	dnet_state_addr_unhash_nolock(st);
 	list_del_init(&st->state_entry);
 	list_del_init(&st->storage_state_entry);
 	dnet_idc_destroy_nolock(st);
@@ -750,6 +994,19 @@ static void dnet_state_remove(struct dnet_net_state *st)
 	pthread_mutex_lock(&n->state_lock);
 	dnet_state_remove_nolock(st);
 	pthread_mutex_unlock(&n->state_lock);
+
+	dnet_route_reclaim(n);
+}
+
+static void dnet_state_stripes_shutdown(struct dnet_net_state *st)
+{
+	int i, num = *(volatile int *)&st->stripe_num;
+
+	/* network thread notices the error and resets stripe */
+	for (i = 0; i < num; ++i) {
+		shutdown(st->stripes[i]->read_s, 2);
+		shutdown(st->stripes[i]->write_s, 2);
+	}
 }
 
 void dnet_state_reset(struct dnet_net_state *st)
@@ -764,7 +1021,11 @@ void dnet_state_reset(struct dnet_net_state *st)
 
 	dnet_unschedule_recv(st);
 
-	dnet_add_reconnect_state(st->n, &st->addr, st->__join_state);
+	/* stripes are closed together with their state, they will be reopened by its reconnection */
+	dnet_state_stripes_shutdown(st);
+
+	if (!st->stripe)
+		dnet_add_reconnect_state(st->n, &st->addr, st->__join_state);
 
 	dnet_state_clean(st);
 	dnet_state_put(st);
@@ -807,10 +1068,17 @@ int dnet_setup_control_nolock(struct dnet_net_state *st)
 	int err, pos;
 
 	if (st->epoll_fd == -1) {
-		pos = io->net_thread_pos;
-		if (++io->net_thread_pos >= io->net_thread_num)
-			io->net_thread_pos = 0;
+		pos = st->net_thread;
+		if ((pos < 0) || (pos >= io->net_thread_num)) {
+			pos = io->net_thread_pos;
+			if (++io->net_thread_pos >= io->net_thread_num)
+				io->net_thread_pos = 0;
+		}
+		st->net_thread = pos;
 		st->epoll_fd = io->net[pos].epoll_fd;
+		st->rcv_pool = &io->net[pos].rcv_pool;
+		st->numa_node = io->net[pos].node;
+		st->uring = io->net[pos].uring;
 
 		err = dnet_schedule_recv(st);
 		if (err)
@@ -853,7 +1121,7 @@ static int dnet_auth_complete(struct dnet_net_state *state, struct dnet_cmd *cmd
 	return cmd->status;
 }
 
-static int dnet_auth_send(struct dnet_net_state *st)
+static int dnet_auth_send(struct dnet_net_state *st, uint64_t cflags)
 {
 	struct dnet_node *n = st->n;
 	struct dnet_trans_control ctl;
@@ -867,7 +1135,7 @@ static int dnet_auth_send(struct dnet_net_state *st)
 	memset(&ctl, 0, sizeof(struct dnet_trans_control));
 
 	ctl.cmd = DNET_CMD_AUTH;
-	ctl.cflags = DNET_FLAGS_DIRECT | DNET_FLAGS_NEED_ACK;
+	ctl.cflags = DNET_FLAGS_DIRECT | DNET_FLAGS_NEED_ACK | cflags;
 	ctl.size = sizeof(struct dnet_auth);
 	ctl.data = &a;
 
@@ -876,10 +1144,120 @@ static int dnet_auth_send(struct dnet_net_state *st)
 	return dnet_trans_alloc_send_state(st, &ctl);
 }
 
-struct dnet_net_state *dnet_state_create(struct dnet_node *n,
+/*
+ * Opens extra connections to the node @st is connected to. They are not added to the route
+ * table and live in the empty state list like client connections, but are never reconnected
+ * on their own. @st holds a reference to every stripe until it is destroyed.
+ * Stripes of joined state announce themselves in auth request, so that the peer
+ * does not throttle them like client connections.
+ * Failure is not fatal, state just uses the stripes it managed to open.
+ */
+static void dnet_state_stripes_create(struct dnet_net_state *st)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_net_state *stripe;
+	int i, s, level, err = 0;
+
+	for (i = 1; i < n->stripe_num; ++i) {
+		if (st->need_exit)
+			break;
+
+		s = dnet_socket_create_addr(n, n->sock_type, n->proto, ((struct sockaddr *)st->addr.addr)->sa_family,
+				(struct sockaddr *)st->addr.addr, st->addr.addr_len, 0);
+		if (s < 0) {
+			err = s;
+			break;
+		}
+
+		/* socket is closed on error */
+		stripe = dnet_state_create(n, 0, NULL, 0, &st->addr, s, &err, st->__join_state, dnet_state_net_process);
+		if (!stripe)
+			break;
+
+		stripe->stripe = i;
+		if (st->__join_state == DNET_JOIN)
+			dnet_auth_send(stripe, DNET_ATTR_SERVER_STRIPE);
+
+		/* stripe is published after its slot is filled, reset either sees it or is seen here */
+		st->stripes[st->stripe_num] = dnet_state_get(stripe);
+		__sync_synchronize();
+		st->stripe_num++;
+		__sync_synchronize();
+
+		if (st->need_exit) {
+			shutdown(stripe->read_s, 2);
+			shutdown(stripe->write_s, 2);
+		}
+
+		dnet_state_put(stripe);
+	}
+
+	level = err ? DNET_LOG_ERROR : DNET_LOG_INFO;
+	dnet_log(n, level, "%s: opened %d stripes out of %d: %d\n",
+			dnet_server_convert_dnet_addr(&st->addr), st->stripe_num, n->stripe_num - 1, err);
+}
+
+/*
+ * Called by check thread: connecting blocks, so stripes of new route table states
+ * are opened here instead of state creation.
+ */
+void dnet_state_stripes_open(struct dnet_node *n)
+{
+	struct dnet_net_state *st, *found;
+	struct dnet_group *g;
+
+	while (atomic_read(&n->stripe_pending) > 0) {
+		found = NULL;
+
+		pthread_mutex_lock(&n->state_lock);
+		list_for_each_entry(g, &n->group_list, group_entry) {
+			list_for_each_entry(st, &g->state_list, state_entry) {
+				if (st->stripe_pending) {
+					found = dnet_state_get(st);
+					break;
+				}
+			}
+
+			if (found)
+				break;
+		}
+
+		if (found) {
+			found->stripe_pending = 0;
+			atomic_dec(&n->stripe_pending);
+		}
+		pthread_mutex_unlock(&n->state_lock);
+
+		if (!found)
+			break;
+
+		dnet_state_stripes_create(found);
+		dnet_state_put(found);
+	}
+}
+
+static void dnet_state_stripes_destroy(struct dnet_net_state *st)
+{
+	int i;
+
+	if (st->stripe_pending) {
+		st->stripe_pending = 0;
+		atomic_dec(&st->n->stripe_pending);
+	}
+
+	for (i = 0; i < st->stripe_num; ++i)
+		dnet_state_put(st->stripes[i]);
+
+	free(st->stripes);
+	st->stripes = NULL;
+	st->stripe_num = 0;
+}
+
+struct dnet_net_state *dnet_state_create_thread(struct dnet_node *n,
 		int group_id, struct dnet_raw_id *ids, int id_num,
 		struct dnet_addr *addr, int s, int *errp, int join,
-		int (* process)(struct dnet_net_state *st, struct epoll_event *ev))
+		int (* process)(struct dnet_net_state *st, struct epoll_event *ev),
+		int net_thread)
 {
 	int err = -ENOMEM;
 	struct dnet_net_state *st;
@@ -916,20 +1294,31 @@ struct dnet_net_state *dnet_state_create(struct dnet_node *n,
 	st->la = 1;
 	st->weight = DNET_STATE_MAX_WEIGHT / 2;
 	st->median_read_time = 1000; /* useconds for start */
+	atomic_init(&st->reads_in_flight, 0);
 
 	INIT_LIST_HEAD(&st->state_entry);
 	INIT_LIST_HEAD(&st->storage_state_entry);
+	INIT_HLIST_NODE(&st->addr_entry);
+	st->uring_send.buf = -1;
 
-	st->trans_root = RB_ROOT;
-	INIT_LIST_HEAD(&st->trans_list);
+	dnet_wheel_init(&st->trans_wheel, dnet_wheel_ticks());
+	INIT_LIST_HEAD(&st->trans_timeout_list);
 
 	st->epoll_fd = -1;
+	st->net_thread = net_thread;
+	st->numa_node = -1;
+
+	err = dnet_trans_table_init(&st->trans_table, DNET_TRANS_TABLE_SIZE);
+	if (err) {
+		dnet_log_err(n, "Failed to allocate transaction table: %d", err);
+		goto err_out_dup_destroy;
+	}
 
 	err = pthread_mutex_init(&st->trans_lock, NULL);
 	if (err) {
 		err = -err;
 		dnet_log_err(n, "Failed to initialize transaction mutex: %d", err);
-		goto err_out_dup_destroy;
+		goto err_out_table_destroy;
 	}
 
 	INIT_LIST_HEAD(&st->send_list);
@@ -972,6 +1361,15 @@ struct dnet_net_state *dnet_state_create(struct dnet_node *n,
 	dnet_state_get(st);
 
 	if (ids && id_num) {
+		/* stripes are opened by check thread, see dnet_state_stripes_open() */
+		if ((n->stripe_num > 1) && (process == dnet_state_net_process)) {
+			st->stripes = malloc((n->stripe_num - 1) * sizeof(struct dnet_net_state *));
+			if (st->stripes) {
+				st->stripe_pending = 1;
+				atomic_inc(&n->stripe_pending);
+			}
+		}
+
 		err = dnet_idc_create(st, group_id, ids, id_num);
 		if (err)
 			goto err_out_send_destroy;
@@ -981,7 +1379,7 @@ struct dnet_net_state *dnet_state_create(struct dnet_node *n,
 			err = dnet_state_join_nolock(st);
 			pthread_mutex_unlock(&n->state_lock);
 
-			err = dnet_auth_send(st);
+			err = dnet_auth_send(st, 0);
 		}
 	} else {
 		pthread_mutex_lock(&n->state_lock);
@@ -1011,9 +1409,13 @@ err_out_unlock:
 	pthread_mutex_unlock(&n->state_lock);
 err_out_send_destroy:
 	dnet_state_put(st);
+	dnet_state_stripes_shutdown(st);
+	dnet_state_stripes_destroy(st);
 	pthread_mutex_destroy(&st->send_lock);
 err_out_trans_destroy:
 	pthread_mutex_destroy(&st->trans_lock);
+err_out_table_destroy:
+	dnet_trans_table_cleanup(&st->trans_table);
 err_out_dup_destroy:
 	dnet_sock_close(st->write_s);
 err_out_free:
@@ -1028,6 +1430,14 @@ err_out_exit:
 	return NULL;
 }
 
+struct dnet_net_state *dnet_state_create(struct dnet_node *n,
+		int group_id, struct dnet_raw_id *ids, int id_num,
+		struct dnet_addr *addr, int s, int *errp, int join,
+		int (* process)(struct dnet_net_state *st, struct epoll_event *ev))
+{
+	return dnet_state_create_thread(n, group_id, ids, id_num, addr, s, errp, join, process, -1);
+}
+
 int dnet_state_num(struct dnet_node *n)
 {
 	struct dnet_net_state *st;
@@ -1050,8 +1460,14 @@ static void dnet_state_send_clean(struct dnet_net_state *st)
 
 	list_for_each_entry_safe(r, tmp, &st->send_list, req_entry) {
 		list_del(&r->req_entry);
+		atomic_sub(&st->n->send_queue_kb, dnet_send_queue_kb(r->hsize + r->dsize));
 		dnet_io_req_free(r);
 	}
+
+	if (st->send_throttled) {
+		st->send_throttled = 0;
+		atomic_dec(&st->n->send_throttled);
+	}
 }
 
 void dnet_state_destroy(struct dnet_net_state *st)
@@ -1067,6 +1483,12 @@ void dnet_state_destroy(struct dnet_net_state *st)
 
 	dnet_state_send_clean(st);
 
+	free(st->rcv_buf);
+
+	dnet_state_stripes_destroy(st);
+
+	dnet_trans_table_cleanup(&st->trans_table);
+
 	pthread_mutex_destroy(&st->send_lock);
 	pthread_mutex_destroy(&st->trans_lock);
 
@@ -1079,20 +1501,17 @@ void dnet_state_destroy(struct dnet_net_state *st)
 int dnet_send_reply(void *state, struct dnet_cmd *cmd, void *odata, unsigned int size, int more)
 {
 	struct dnet_net_state *st = state;
+	struct dnet_io_req *r;
 	struct dnet_cmd *c;
-	void *data;
-	int err;
 
 	if (st == st->n->st)
 		return 0;
 
-	c = malloc(sizeof(struct dnet_cmd) + size);
-	if (!c)
+	r = dnet_io_req_alloc(sizeof(struct dnet_cmd) + size, 0);
+	if (!r)
 		return -ENOMEM;
 
-	memset(c, 0, sizeof(struct dnet_cmd) + size);
-
-	data = c + 1;
+	c = r->header;
 	*c = *cmd;
 
 	if ((cmd->flags & DNET_FLAGS_NEED_ACK) || more)
@@ -1102,77 +1521,368 @@ int dnet_send_reply(void *state, struct dnet_cmd *cmd, void *odata, unsigned int
 	c->trans |= DNET_TRANS_REPLY;
 
 	if (size)
-		memcpy(data, odata, size);
+		memcpy(c + 1, odata, size);
 
 	dnet_log(st->n, DNET_LOG_NOTICE, "%s: %s: reply: size: %u, cflags: %llx.\n",
 		dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), size, (unsigned long long)c->flags);
 
 	dnet_convert_cmd(c);
 
-	err = dnet_send(st, c, sizeof(struct dnet_cmd) + size);
-	free(c);
+	dnet_io_req_enqueue(st, r);
+	return 0;
+}
+
+#ifndef MSG_MORE
+#define MSG_MORE	0
+#endif
 
-	return err;
+static int dnet_io_req_iov(struct dnet_io_req *r, size_t offset, struct iovec *iov, size_t *total)
+{
+	int num = 0;
+
+	if (r->hsize && r->header) {
+		if (offset < r->hsize) {
+			iov[num].iov_base = r->header + offset;
+			iov[num].iov_len = r->hsize - offset;
+			*total += iov[num].iov_len;
+			num++;
+			offset = 0;
+		} else {
+			offset -= r->hsize;
+		}
+	}
+
+	if (r->dsize && r->data && offset < r->dsize) {
+		iov[num].iov_base = r->data + offset;
+		iov[num].iov_len = r->dsize - offset;
+		*total += iov[num].iov_len;
+		num++;
+	}
+
+	return num;
 }
 
-int dnet_send_request(struct dnet_net_state *st, struct dnet_io_req *r)
+static inline int dnet_io_req_has_file(struct dnet_io_req *r)
+{
+	return r->fd >= 0 && r->fsize;
+}
+
+/*
+ * Accounts @sent bytes against the first @req_num requests in send queue,
+ * sends file part of the last one when its memory part is complete
+ * and frees requests which were completely sent.
+ * With @async set file part is not sent here, request is freed once
+ * dnet_send_list_uring() has sent it.
+ */
+static int dnet_send_list_complete(struct dnet_net_state *st, int req_num, size_t sent, int async)
 {
-	int cork;
+	struct dnet_io_req *r;
+	size_t mem, size;
 	int err = 0;
-	size_t offset = st->send_offset;
 
-	/* Use TCP_CORK to send headers and packet body in one piece */
-	cork = 1;
-	setsockopt(st->write_s, IPPROTO_TCP, TCP_CORK, &cork, 4);
+	while (req_num-- > 0) {
+		pthread_mutex_lock(&st->send_lock);
+		r = list_first_entry(&st->send_list, struct dnet_io_req, req_entry);
+		pthread_mutex_unlock(&st->send_lock);
 
-	if (r->hsize && r->header && st->send_offset < r->hsize) {
-		err = dnet_send_nolock(st, r->header + offset, r->hsize - offset);
-		if (err)
-			goto err_out_exit;
+		mem = r->hsize + r->dsize;
+		if (st->send_offset < mem) {
+			size = mem - st->send_offset;
+			if (size > sent)
+				size = sent;
+
+			st->send_offset += size;
+			sent -= size;
+
+			if (st->send_offset < mem) {
+				err = -EAGAIN;
+				break;
+			}
+		}
+
+		if (dnet_io_req_has_file(r)) {
+			size = st->send_offset - mem;
+
+			if (async) {
+				if (size < r->fsize)
+					break;
+			} else {
+				err = dnet_send_fd_nolock(st, r->fd, r->local_offset + size, r->fsize - size);
+				if (err)
+					break;
+			}
+
+			mem += r->fsize;
+		}
+
+		if (r->hsize > sizeof(struct dnet_cmd)) {
+			struct dnet_cmd *cmd = r->header;
+			int nonblocking = !!(cmd->flags & DNET_FLAGS_NOLOCK);
+
+			dnet_log(st->n, DNET_LOG_DEBUG, "%s: %s: SENT %s cmd: %s: cmd-size: %llu, nonblocking: %d\n",
+				dnet_state_dump_addr(st), dnet_dump_id(r->header),
+				nonblocking ? "nonblocking" : "blocking",
+				dnet_cmd_string(cmd->cmd),
+				(unsigned long long)cmd->size, nonblocking);
+		}
+
+		pthread_mutex_lock(&st->send_lock);
+		list_del(&r->req_entry);
+		dnet_send_queue_del(st, r);
+		pthread_mutex_unlock(&st->send_lock);
+
+		dnet_io_req_free(r);
+		st->send_offset = 0;
 	}
 
-	if (r->dsize && r->data && st->send_offset < (r->dsize + r->hsize)) {
-		offset = st->send_offset - r->hsize;
-		err = dnet_send_nolock(st, r->data + offset, r->dsize - offset);
-		if (err)
-			goto err_out_exit;
+	return err;
+}
+
+/*
+ * Fills @iov with memory parts of as many queued requests as fit into it,
+ * starting at @st->send_offset of the first one. File-backed request ends the batch.
+ * Returns number of filled entries or -EAGAIN if send queue is empty,
+ * sending is unscheduled then.
+ */
+static int dnet_send_list_iov(struct dnet_net_state *st, struct iovec *iov,
+		int *req_num, int *more, int *file, size_t *total)
+{
+	struct dnet_io_req *r;
+	size_t offset = st->send_offset;
+	int iov_num = 0;
+
+	*req_num = *more = *file = 0;
+	*total = 0;
+
+	pthread_mutex_lock(&st->send_lock);
+	if (list_empty(&st->send_list)) {
+		dnet_unschedule_send(st);
+		pthread_mutex_unlock(&st->send_lock);
+
+		return -EAGAIN;
 	}
 
-	if (r->fd >= 0 && r->fsize && st->send_offset < (r->dsize + r->hsize + r->fsize)) {
-		offset = st->send_offset - r->dsize - r->hsize;
-		err = dnet_send_fd_nolock(st, r->fd, r->local_offset + offset, r->fsize - offset);
-		if (err)
-			goto err_out_exit;
+	list_for_each_entry(r, &st->send_list, req_entry) {
+		if (iov_num + 2 > DNET_SEND_IOV_MAX) {
+			*more = 1;
+			break;
+		}
+
+		iov_num += dnet_io_req_iov(r, offset, &iov[iov_num], total);
+		offset = 0;
+		(*req_num)++;
+
+		if (dnet_io_req_has_file(r)) {
+			*more = *file = 1;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&st->send_lock);
+
+	return iov_num;
+}
+
+/*
+ * io_uring flavour of dnet_send_list(): consumes completion of the previous send operation
+ * and submits the next one. Memory parts of queued requests are sent with a single
+ * sendmsg request, file part of the first request is read into registered buffer
+ * and sent from it chunk by chunk. MSG_MORE is used instead of corking the socket.
+ *
+ * Returns -EAGAIN while operation is in flight or there is nothing to send.
+ */
+static int dnet_send_list_uring(struct dnet_net_state *st)
+{
+	struct dnet_uring_send *us = &st->uring_send;
+	struct dnet_io_req *r;
+	int op, res = 0, iov_num, req_num, more, file;
+	size_t mem, size, total;
+	int err;
+
+	err = dnet_uring_send_result(st, &res);
+	if (err < 0)
+		return -EAGAIN;
+
+	op = err ? us->op : DNET_URING_SEND_NONE;
+	err = 0;
 
-	if (r->hsize > sizeof(struct dnet_cmd)) {
-		struct dnet_cmd *cmd = r->header;
-		int nonblocking = !!(cmd->flags & DNET_FLAGS_NOLOCK);
+	/* interrupted operation is submitted again below */
+	if (res == -EAGAIN || res == -EINTR || res == -ECANCELED)
+		op = DNET_URING_SEND_NONE;
 
-		dnet_log(st->n, DNET_LOG_DEBUG, "%s: %s: SENT %s cmd: %s: cmd-size: %llu, nonblocking: %d\n",
-			dnet_state_dump_addr(st), dnet_dump_id(r->header),
-			nonblocking ? "nonblocking" : "blocking",
-			dnet_cmd_string(cmd->cmd),
-			(unsigned long long)cmd->size, nonblocking);
+	if (op != DNET_URING_SEND_NONE && res <= 0) {
+		err = res;
+		if (op == DNET_URING_SEND_FILE_READ && !res) {
+			err = -ENODATA;
+			dnet_log(st->n, DNET_LOG_ERROR, "%s: looks like truncated file\n", dnet_state_dump_addr(st));
+		} else if (!res) {
+			err = -ECONNRESET;
+			dnet_log(st->n, DNET_LOG_ERROR, "Peer %s has dropped the connection: socket: %d.\n",
+					dnet_state_dump_addr(st), st->write_s);
+		} else {
+			dnet_log(st->n, DNET_LOG_ERROR, "%s: failed to send data: %d\n", dnet_state_dump_addr(st), err);
+		}
+		goto err_out_exit;
 	}
 
-err_out_exit:
-	if (st->send_offset == (r->dsize + r->hsize + r->fsize)) {
+	switch (op) {
+		case DNET_URING_SEND_MSG:
+			st->io_bytes += res;
+			err = dnet_send_list_complete(st, us->req_num, res, 1);
+			break;
+		case DNET_URING_SEND_FILE_READ:
+			us->buf_offset = 0;
+			us->buf_size = res;
+			break;
+		case DNET_URING_SEND_FILE:
+			st->io_bytes += res;
+			st->send_offset += res;
+			us->buf_offset += res;
+			err = dnet_send_list_complete(st, 1, 0, 1);
+			break;
+	}
+
+	while (!err || err == -EAGAIN) {
 		pthread_mutex_lock(&st->send_lock);
-		list_del(&r->req_entry);
+		if (list_empty(&st->send_list)) {
+			dnet_unschedule_send(st);
+			/* queueing thread arms poll request after the lock is dropped */
+			dnet_uring_send_idle(st);
+			pthread_mutex_unlock(&st->send_lock);
+
+			dnet_uring_file_release(st);
+			return -EAGAIN;
+		}
+		r = list_first_entry(&st->send_list, struct dnet_io_req, req_entry);
 		pthread_mutex_unlock(&st->send_lock);
 
-		dnet_io_req_free(r);
-		st->send_offset = 0;
+		mem = r->hsize + r->dsize;
+		if (st->send_offset < mem || !dnet_io_req_has_file(r)) {
+			dnet_uring_file_release(st);
+
+			iov_num = dnet_send_list_iov(st, us->iov, &req_num, &more, &file, &total);
+			if (iov_num > 0) {
+				err = dnet_uring_sendmsg(st, req_num, iov_num, more ? MSG_MORE : 0);
+				if (!err)
+					return -EAGAIN;
+				break;
+			}
+
+			/* nothing to send in memory, file part is sent by the next pass */
+			err = dnet_send_list_complete(st, req_num, 0, 1);
+			continue;
+		}
+
+		size = st->send_offset - mem;
+
+		if (us->buf_offset < us->buf_size) {
+			more = size + us->buf_size - us->buf_offset < r->fsize;
+			err = dnet_uring_file_send(st, more ? MSG_MORE : 0);
+			if (!err)
+				return -EAGAIN;
+			break;
+		}
+
+		err = dnet_uring_file_read(st, r->fd, r->local_offset + size, r->fsize - size);
+		if (!err)
+			return -EAGAIN;
+
+		if (err != -ENOBUFS)
+			break;
+
+		/* all registered buffers are busy, poll request is armed if socket is full */
+		err = dnet_send_fd_nolock(st, r->fd, r->local_offset + size, r->fsize - size);
+		if (err)
+			break;
+
+		err = dnet_send_list_complete(st, 1, 0, 1);
 	}
 
+err_out_exit:
+	dnet_uring_send_idle(st);
+
 	if (err && err != -EAGAIN) {
 		dnet_log(st->n, DNET_LOG_ERROR, "%s: setting send need_exit to %d\n", dnet_state_dump_addr(st), err);
 		st->need_exit = err;
+		dnet_uring_file_release(st);
+	}
+
+	return err;
+}
+
+/*
+ * Sends single batch from state's send queue: memory parts of as many queued requests
+ * as fit into iovec array are written with a single sendmsg() call,
+ * file-backed request ends the batch and its file part is sent with sendfile()
+ * right after its headers. Socket is corked only when such request is present.
+ *
+ * Returns 0 when the batch has been sent completely: network thread charges sent bytes
+ * against the state's budget and calls us again only if it is not spent yet, the same
+ * way it handles received commands, so the rest of the queue waits for the next wakeup.
+ *
+ * Only network thread which owns @st removes requests from the send queue,
+ * so the head entries remain valid while @st->send_lock is dropped.
+ * Progress within the first request is tracked in @st->send_offset.
+ */
+int dnet_send_list(struct dnet_net_state *st)
+{
+	struct iovec iov[DNET_SEND_IOV_MAX];
+	struct msghdr msg;
+	int iov_num, req_num, more, file, cork, corked = 0;
+	size_t total;
+	ssize_t err = 0;
+
+	if (dnet_uring_send_async(st))
+		return dnet_send_list_uring(st);
+
+	iov_num = dnet_send_list_iov(st, iov, &req_num, &more, &file, &total);
+	if (iov_num < 0) {
+		err = iov_num;
+		goto err_out_exit;
+	}
+
+	if (file) {
+		cork = 1;
+		setsockopt(st->write_s, IPPROTO_TCP, TCP_CORK, &cork, 4);
+		corked = 1;
+	}
+
+	err = 0;
+	if (iov_num) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov_num;
+
+		err = sendmsg(st->write_s, &msg, more ? MSG_MORE : 0);
+		if (err < 0) {
+			err = -errno;
+			if (err != -EAGAIN)
+				dnet_log_err(st->n, "Failed to send packet: size: %zu, socket: %d",
+						total, st->write_s);
+			goto err_out_exit;
+		}
+
+		if (err == 0) {
+			dnet_log(st->n, DNET_LOG_ERROR, "Peer %s has dropped the connection: socket: %d.\n",
+					dnet_state_dump_addr(st), st->write_s);
+			err = -ECONNRESET;
+			goto err_out_exit;
+		}
+
+		st->io_bytes += err;
+	}
+
+	err = dnet_send_list_complete(st, req_num, err, 0);
+
+err_out_exit:
+	if (err && err != -EAGAIN) {
+		dnet_log(st->n, DNET_LOG_ERROR, "%s: setting send need_exit to %d\n", dnet_state_dump_addr(st), (int)err);
+		st->need_exit = err;
 	}
 
-	cork = 0;
-	setsockopt(st->write_s, IPPROTO_TCP, TCP_CORK, &cork, 4);
+	if (corked) {
+		cork = 0;
+		setsockopt(st->write_s, IPPROTO_TCP, TCP_CORK, &cork, 4);
+	}
 
 	return err;
 }
@@ -20,6 +20,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sched.h>
+#include <endian.h>
 
 #include "elliptics.h"
 #include "elliptics/interface.h"
@@ -36,6 +38,10 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 	memset(n, 0, sizeof(struct dnet_node));
 
 	atomic_init(&n->trans, 0);
+	atomic_init(&n->send_queue_kb, 0);
+	atomic_init(&n->send_throttled, 0);
+	atomic_init(&n->send_throttle_num, 0);
+	atomic_init(&n->stripe_pending, 0);
 
 	err = dnet_log_init(n, cfg->log);
 	if (err)
@@ -47,10 +53,19 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 		goto err_out_free;
 	}
 
+	err = pthread_mutex_init(&n->route_sync_lock, NULL);
+	if (err) {
+		dnet_log_err(n, "Failed to initialize route lock: err: %d", err);
+		goto err_out_destroy_state;
+	}
+	atomic_init(&n->route_epoch, 0);
+	atomic_init(&n->route_readers[0], 0);
+	atomic_init(&n->route_readers[1], 0);
+
 	n->wait = dnet_wait_alloc(0);
 	if (!n->wait) {
 		dnet_log(n, DNET_LOG_ERROR, "Failed to allocate wait structure.\n");
-		goto err_out_destroy_state;
+		goto err_out_destroy_route;
 	}
 
 	err = dnet_counter_init(n);
@@ -100,6 +115,8 @@ err_out_destroy_counter:
 	dnet_counter_destroy(n);
 err_out_destroy_wait:
 	dnet_wait_put(n->wait);
+err_out_destroy_route:
+	pthread_mutex_destroy(&n->route_sync_lock);
 err_out_destroy_state:
 	pthread_mutex_destroy(&n->state_lock);
 err_out_free:
@@ -161,7 +178,7 @@ static int dnet_idc_compare(const void *k1, const void *k2)
 	return dnet_id_cmp_str(id1->raw.id, id2->raw.id);
 }
 
-static void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
+void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
 {
 	int i, pos;
 
@@ -172,17 +189,113 @@ static void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
 		}
 	}
 
+	/* compaction keeps the remaining ids in order, no need to sort them again */
 	g->id_num = pos;
-
-	qsort(g->ids,  g->id_num, sizeof(struct dnet_state_id), dnet_idc_compare);
 	st->idc = NULL;
 }
 
+/*
+ * Merges @id_num sorted @ids into sorted group id array, ids already present
+ * in the group (or repeated in @ids) are skipped. Returns number of added ids
+ * or negative error, group is left untouched if there is nothing to add.
+ */
+int dnet_idc_merge_ids(struct dnet_group *g, struct dnet_state_id *ids, int id_num)
+{
+	struct dnet_state_id *merged, *last = NULL;
+	int i = 0, j = 0, num = 0, cmp;
+
+	merged = malloc((g->id_num + id_num) * sizeof(struct dnet_state_id));
+	if (!merged)
+		return -ENOMEM;
+
+	while (j < id_num) {
+		if (i < g->id_num) {
+			cmp = dnet_idc_compare(&g->ids[i], &ids[j]);
+			if (cmp <= 0) {
+				if (!cmp)
+					j++;
+				last = &merged[num + i];
+				memcpy(last, &g->ids[i], sizeof(struct dnet_state_id));
+				i++;
+				continue;
+			}
+		}
+
+		if (!last || dnet_idc_compare(last, &ids[j])) {
+			last = &merged[num + i];
+			memcpy(last, &ids[j], sizeof(struct dnet_state_id));
+			num++;
+		}
+		j++;
+	}
+
+	if (!num) {
+		free(merged);
+		return 0;
+	}
+
+	memcpy(&merged[num + i], &g->ids[i], (g->id_num - i) * sizeof(struct dnet_state_id));
+
+	free(g->ids);
+	g->ids = merged;
+	g->id_num += num;
+
+	return num;
+}
+
+static unsigned int dnet_addr_hash(struct dnet_addr *addr)
+{
+	unsigned int hash = 2166136261U, i, len = addr->addr_len;
+
+	if (len > DNET_ADDR_SIZE)
+		len = DNET_ADDR_SIZE;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= addr->addr[i];
+		hash *= 16777619U;
+	}
+
+	return (hash ^ len) % DNET_STATE_ADDR_HASH_SIZE;
+}
+
+/*
+ * States are added to the tail of the bucket, so that lookup returns the oldest
+ * state with given address, the same one group list walk used to find.
+ */
+static void dnet_state_addr_hash_nolock(struct dnet_net_state *st)
+{
+	struct hlist_head *head = &st->n->addr_hash[dnet_addr_hash(&st->addr)];
+	struct hlist_node *last;
+
+	if (!hlist_unhashed(&st->addr_entry))
+		return;
+
+	if (hlist_empty(head)) {
+		hlist_add_head(&st->addr_entry, head);
+		return;
+	}
+
+	for (last = head->first; last->next; last = last->next)
+		;
+
+	hlist_add_after(last, &st->addr_entry);
+}
+
+void dnet_state_addr_unhash_nolock(struct dnet_net_state *st)
+{
+	if (hlist_unhashed(&st->addr_entry))
+		return;
+
+	__hlist_del(&st->addr_entry);
+	INIT_HLIST_NODE(&st->addr_entry);
+}
+
 int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id *ids, int id_num)
 {
 	struct dnet_node *n = st->n;
 	struct dnet_idc *idc;
 	struct dnet_group *g;
+	struct dnet_state_id *sorted;
 	int err = -ENOMEM, i, num;
 	struct timeval start, end;
 	long diff;
@@ -201,6 +314,18 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 		sid->idc = idc;
 	}
 
+	/*
+	 * Sort a copy of the new ids outside of the state lock, so that they can be
+	 * merged into the group in a single pass. idc->ids keeps the order the
+	 * node announced them in.
+	 */
+	sorted = malloc(sizeof(struct dnet_state_id) * id_num);
+	if (!sorted)
+		goto err_out_free;
+
+	memcpy(sorted, idc->ids, sizeof(struct dnet_state_id) * id_num);
+	qsort(sorted, id_num, sizeof(struct dnet_state_id), dnet_idc_compare);
+
 	pthread_mutex_lock(&n->state_lock);
 
 	g = dnet_group_search(n, group_id);
@@ -212,30 +337,15 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 		list_add_tail(&g->group_entry, &n->group_list);
 	}
 
-	g->ids = realloc(g->ids, (g->id_num + id_num) * sizeof(struct dnet_state_id));
-	if (!g->ids) {
-		g->id_num = 0;
+	num = dnet_idc_merge_ids(g, sorted, id_num);
+	if (num <= 0) {
+		err = num ? num : -EEXIST;
 		goto err_out_unlock_put;
 	}
 
-	num = 0;
-	for (i=0; i<id_num; ++i) {
-		if (!bsearch(&idc->ids[i], g->ids, g->id_num, sizeof(struct dnet_state_id), dnet_idc_compare)) {
-			memcpy(&g->ids[g->id_num + num], &idc->ids[i], sizeof(struct dnet_state_id));
-			num++;
-		}
-	}
-
-	if (!num) {
-		err = -EEXIST;
-		goto err_out_unlock_put;
-	}
-
-	g->id_num += num;
-	qsort(g->ids, g->id_num, sizeof(struct dnet_state_id), dnet_idc_compare);
-
 	list_add_tail(&st->state_entry, &g->state_list);
 	list_add_tail(&st->storage_state_entry, &n->storage_state_list);
+	dnet_state_addr_hash_nolock(st);
 
 	idc->id_num = id_num;
 	idc->st = st;
@@ -255,8 +365,12 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 	if (err)
 		goto err_out_remove_nolock;
 
+	dnet_route_update_nolock(n);
 	pthread_mutex_unlock(&n->state_lock);
 
+	free(sorted);
+	dnet_route_reclaim(n);
+
 	gettimeofday(&end, NULL);
 	diff = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
 
@@ -285,12 +399,15 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 
 err_out_remove_nolock:
 	dnet_idc_remove_ids(st, g);
+	dnet_state_addr_unhash_nolock(st);
 	list_del_init(&st->state_entry);
 	list_del_init(&st->storage_state_entry);
 err_out_unlock_put:
 	dnet_group_put(g);
 err_out_unlock:
 	pthread_mutex_unlock(&n->state_lock);
+	free(sorted);
+err_out_free:
 	free(idc);
 err_out_exit:
 	gettimeofday(&end, NULL);
@@ -312,6 +429,8 @@ void dnet_idc_destroy_nolock(struct dnet_net_state *st)
 	dnet_idc_remove_ids(st, g);
 	dnet_group_put(g);
 	free(idc);
+
+	dnet_route_update_nolock(st->n);
 }
 
 static int __dnet_idc_search(struct dnet_group *g, struct dnet_id *id)
@@ -345,6 +464,277 @@ static struct dnet_state_id *dnet_idc_search(struct dnet_group *g, struct dnet_i
 	return &g->ids[__dnet_idc_search(g, id)];
 }
 
+static int dnet_route_group_compare(const void *k1, const void *k2)
+{
+	const struct dnet_route_group *g1 = k1;
+	const struct dnet_route_group *g2 = k2;
+
+	if (g1->group_id < g2->group_id)
+		return -1;
+	if (g1->group_id > g2->group_id)
+		return 1;
+	return 0;
+}
+
+static void dnet_route_table_destroy(struct dnet_route_table *rt)
+{
+	int i;
+
+	for (i = 0; i < rt->state_num; ++i)
+		dnet_state_put(rt->states[i]);
+
+	free(rt);
+}
+
+static inline uint64_t dnet_id_prefix(const unsigned char *id)
+{
+	uint64_t prefix;
+
+	memcpy(&prefix, id, sizeof(prefix));
+	return be64toh(prefix);
+}
+
+/*
+ * Compare ids with equal prefixes, the rest is compared by 8-byte words
+ * in the same (big-endian) order dnet_id_cmp_str() compares bytes in.
+ */
+static inline int dnet_id_cmp_tail(const unsigned char *id1, const unsigned char *id2)
+{
+	uint64_t w1, w2;
+	int i;
+
+	for (i = sizeof(uint64_t); i < DNET_ID_SIZE; i += sizeof(uint64_t)) {
+		w1 = dnet_id_prefix(id1 + i);
+		w2 = dnet_id_prefix(id2 + i);
+
+		if (w1 < w2)
+			return -1;
+		if (w1 > w2)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Fill Eytzinger index of the group from its sorted ids by in-order traversal
+ * of the implicit tree, where children of node @k are @2k and @2k+1.
+ */
+int dnet_route_index_build(struct dnet_route_group *g, struct dnet_state_id *ids, int i, int k)
+{
+	if (k <= g->id_num) {
+		i = dnet_route_index_build(g, ids, i, 2 * k);
+
+		g->prefix[k] = dnet_id_prefix(ids[i].raw.id);
+		g->pos[k] = i;
+		i++;
+
+		i = dnet_route_index_build(g, ids, i, 2 * k + 1);
+	}
+
+	return i;
+}
+
+/*
+ * Publish new snapshot of the route table, previous one is moved to the list of retired
+ * snapshots, which dnet_route_reclaim() frees after @n->state_lock is dropped.
+ * If snapshot can not be allocated, lookups fall back to the locked route table.
+ */
+void dnet_route_update_nolock(struct dnet_node *n)
+{
+	struct dnet_route_table *rt, *old;
+	struct dnet_route_group *rg;
+	struct dnet_route_id *rid;
+	struct dnet_group *g;
+	struct dnet_idc *idc;
+	uint64_t *prefix;
+	int *pos;
+	int group_num = 0, id_num = 0, i, j, first;
+
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (g->id_num) {
+			group_num++;
+			id_num += g->id_num;
+		}
+	}
+
+	rt = malloc(sizeof(struct dnet_route_table) + group_num * sizeof(struct dnet_route_group) +
+			id_num * (sizeof(struct dnet_route_id) + sizeof(struct dnet_net_state *)) +
+			(id_num + group_num) * (sizeof(uint64_t) + sizeof(int)));
+	if (!rt) {
+		dnet_log(n, DNET_LOG_ERROR, "Failed to allocate route table snapshot: groups: %d, ids: %d.\n",
+				group_num, id_num);
+		goto out_publish;
+	}
+
+	rt->next = NULL;
+	rt->groups = (struct dnet_route_group *)(rt + 1);
+	rid = (struct dnet_route_id *)(rt->groups + group_num);
+	rt->states = (struct dnet_net_state **)(rid + id_num);
+	prefix = (uint64_t *)(rt->states + id_num);
+	pos = (int *)(prefix + id_num + group_num);
+	rt->group_num = 0;
+	rt->state_num = 0;
+
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (!g->id_num)
+			continue;
+
+		rg = &rt->groups[rt->group_num++];
+		rg->group_id = g->group_id;
+		rg->id_num = g->id_num;
+		rg->ids = rid;
+		rg->prefix = prefix;
+		rg->pos = pos;
+
+		dnet_route_index_build(rg, g->ids, 0, 1);
+		prefix += g->id_num + 1;
+		pos += g->id_num + 1;
+
+		first = rt->state_num;
+		for (i = 0, idc = NULL; i < g->id_num; ++i) {
+			rid->raw = g->ids[i].raw;
+			rid->st = g->ids[i].idc->st;
+			rid++;
+
+			if (g->ids[i].idc == idc)
+				continue;
+			idc = g->ids[i].idc;
+
+			/* every state is referenced once, it has only a few ids in its group */
+			for (j = first; j < rt->state_num; ++j) {
+				if (rt->states[j] == idc->st)
+					break;
+			}
+			if (j == rt->state_num)
+				rt->states[rt->state_num++] = dnet_state_get(idc->st);
+		}
+	}
+
+	qsort(rt->groups, rt->group_num, sizeof(struct dnet_route_group), dnet_route_group_compare);
+
+out_publish:
+	old = n->route;
+	/* snapshot has to be completely visible before it is published */
+	__sync_synchronize();
+	n->route = rt;
+
+	if (old) {
+		old->next = n->route_retired;
+		n->route_retired = old;
+	}
+}
+
+/*
+ * Wait until every lookup which could have seen retired snapshots is completed.
+ * Lookup which sampled epoch right before it was switched may still enter old
+ * readers counter, so it is switched and drained twice.
+ */
+static void dnet_route_synchronize(struct dnet_node *n)
+{
+	int i, idx;
+
+	pthread_mutex_lock(&n->route_sync_lock);
+	for (i = 0; i < 2; ++i) {
+		idx = atomic_read(&n->route_epoch) & 1;
+		atomic_inc(&n->route_epoch);
+
+		while (atomic_read(&n->route_readers[idx]))
+			sched_yield();
+	}
+	pthread_mutex_unlock(&n->route_sync_lock);
+}
+
+/*
+ * Free retired route table snapshots. Must be called without @n->state_lock held,
+ * since it may drop the last reference to the state.
+ */
+void dnet_route_reclaim(struct dnet_node *n)
+{
+	struct dnet_route_table *rt, *next;
+
+	pthread_mutex_lock(&n->state_lock);
+	rt = n->route_retired;
+	n->route_retired = NULL;
+	pthread_mutex_unlock(&n->state_lock);
+
+	if (!rt)
+		return;
+
+	dnet_route_synchronize(n);
+
+	for (; rt; rt = next) {
+		next = rt->next;
+		dnet_route_table_destroy(rt);
+	}
+}
+
+static void dnet_route_cleanup(struct dnet_node *n)
+{
+	pthread_mutex_lock(&n->state_lock);
+	if (n->route) {
+		n->route->next = n->route_retired;
+		n->route_retired = n->route;
+		n->route = NULL;
+	}
+	pthread_mutex_unlock(&n->state_lock);
+
+	dnet_route_reclaim(n);
+}
+
+static struct dnet_route_table *dnet_route_read_lock(struct dnet_node *n, int *idx)
+{
+	*idx = atomic_read(&n->route_epoch) & 1;
+	atomic_inc(&n->route_readers[*idx]);
+
+	return n->route;
+}
+
+static void dnet_route_read_unlock(struct dnet_node *n, int idx)
+{
+	atomic_dec(&n->route_readers[idx]);
+}
+
+static struct dnet_route_group *dnet_route_group_search(struct dnet_route_table *rt, unsigned int group_id)
+{
+	struct dnet_route_group key;
+
+	key.group_id = group_id;
+	return bsearch(&key, rt->groups, rt->group_num, sizeof(struct dnet_route_group), dnet_route_group_compare);
+}
+
+/*
+ * Same as __dnet_idc_search(): position of the last id which is not greater than @id,
+ * or the last id in the group if all of them are greater, since ids form a ring.
+ *
+ * Lower bound of the @id prefix is found in the Eytzinger index, only ids sharing
+ * the same prefix (which practically never happens with hashed ids) are compared in full.
+ */
+int dnet_route_id_search(struct dnet_route_group *g, struct dnet_id *id)
+{
+	uint64_t key = dnet_id_prefix(id->id);
+	int k = 1, i;
+
+	while (k <= g->id_num) {
+		/* descendants three levels below fit into a single cache line */
+		__builtin_prefetch(g->prefix + 8 * k);
+		k = 2 * k + (g->prefix[k] < key);
+	}
+	/* drop trailing right turns and the last left one to get to the lower bound node */
+	k >>= __builtin_ffs(~k);
+
+	i = k ? g->pos[k] : g->id_num;
+
+	while ((i < g->id_num) && (dnet_id_prefix(g->ids[i].raw.id) == key) &&
+			(dnet_id_cmp_tail(g->ids[i].raw.id, id->id) <= 0))
+		i++;
+
+	if (--i < 0)
+		i = g->id_num - 1;
+
+	return i;
+}
+
 static int dnet_search_range_nolock(struct dnet_node *n, struct dnet_id *id, struct dnet_raw_id *start, struct dnet_raw_id *next)
 {
 	struct dnet_state_id *sid;
@@ -371,7 +761,30 @@ static int dnet_search_range_nolock(struct dnet_node *n, struct dnet_id *id, str
 
 int dnet_search_range(struct dnet_node *n, struct dnet_id *id, struct dnet_raw_id *start, struct dnet_raw_id *next)
 {
-	int err;
+	struct dnet_route_table *rt;
+	struct dnet_route_group *g;
+	int err, idx, pos;
+
+	rt = dnet_route_read_lock(n, &idx);
+	if (rt) {
+		err = -ENOENT;
+
+		g = dnet_route_group_search(rt, id->group_id);
+		if (g) {
+			pos = dnet_route_id_search(g, id);
+			memcpy(start, &g->ids[pos].raw, sizeof(struct dnet_raw_id));
+
+			if (++pos >= g->id_num)
+				pos = 0;
+			memcpy(next, &g->ids[pos].raw, sizeof(struct dnet_raw_id));
+
+			err = 0;
+		}
+		dnet_route_read_unlock(n, idx);
+
+		return err;
+	}
+	dnet_route_read_unlock(n, idx);
 
 	pthread_mutex_lock(&n->state_lock);
 	err = dnet_search_range_nolock(n, id, start, next);
@@ -409,19 +822,13 @@ static struct dnet_net_state *__dnet_state_search(struct dnet_node *n, struct dn
 struct dnet_net_state *dnet_state_search_by_addr(struct dnet_node *n, struct dnet_addr *addr)
 {
 	struct dnet_net_state *st, *found = NULL;
-	struct dnet_group *g;
+	struct hlist_node *pos;
 
 	pthread_mutex_lock(&n->state_lock);
-	list_for_each_entry(g, &n->group_list, group_entry) {
-		list_for_each_entry(st, &g->state_list, state_entry) {
-			if (st->addr.addr_len == addr->addr_len &&
-					!memcmp(addr, &st->addr, st->addr.addr_len)) {
-				found = st;
-				break;
-			}
-		}
-		if (found) {
-			dnet_state_get(found);
+	hlist_for_each_entry(st, pos, &n->addr_hash[dnet_addr_hash(addr)], addr_entry) {
+		if (st->addr.addr_len == addr->addr_len &&
+				!memcmp(addr, &st->addr, st->addr.addr_len)) {
+			found = dnet_state_get(st);
 			break;
 		}
 	}
@@ -450,19 +857,45 @@ err_out_exit:
 	return found;
 }
 
-struct dnet_net_state *dnet_state_get_first(struct dnet_node *n, struct dnet_id *id)
+/*
+ * Lock-free equivalent of dnet_state_search_nolock(), it looks into route table snapshot
+ * and takes route table lock only if there is no snapshot.
+ */
+static struct dnet_net_state *dnet_state_search(struct dnet_node *n, struct dnet_id *id)
 {
-	struct dnet_net_state *found;
+	struct dnet_net_state *found = NULL;
+	struct dnet_route_table *rt;
+	struct dnet_route_group *g;
+	int idx;
+
+	rt = dnet_route_read_lock(n, &idx);
+	if (rt) {
+		g = dnet_route_group_search(rt, id->group_id);
+		if (g)
+			found = dnet_state_get(g->ids[dnet_route_id_search(g, id)].st);
+		dnet_route_read_unlock(n, idx);
+
+		return found;
+	}
+	dnet_route_read_unlock(n, idx);
 
 	pthread_mutex_lock(&n->state_lock);
 	found = dnet_state_search_nolock(n, id);
+	pthread_mutex_unlock(&n->state_lock);
+
+	return found;
+}
+
+struct dnet_net_state *dnet_state_get_first(struct dnet_node *n, struct dnet_id *id)
+{
+	struct dnet_net_state *found;
+
+	found = dnet_state_search(n, id);
 	if (found == n->st) {
 		dnet_state_put(found);
 		found = NULL;
 	}
 
-	pthread_mutex_unlock(&n->state_lock);
-
 	return found;
 }
 
@@ -472,13 +905,7 @@ struct dnet_net_state *dnet_state_get_first(struct dnet_node *n, struct dnet_id
  */
 struct dnet_net_state *dnet_node_state(struct dnet_node *n)
 {
-	struct dnet_net_state *found;
-
-	pthread_mutex_lock(&n->state_lock);
-	found = dnet_state_search_nolock(n, &n->id);
-	pthread_mutex_unlock(&n->state_lock);
-
-	return found;
+	return dnet_state_search(n, &n->id);
 }
 
 struct dnet_node *dnet_node_create(struct dnet_config *cfg)
@@ -521,12 +948,24 @@ struct dnet_node *dnet_node_create(struct dnet_config *cfg)
 		}
 	}
 
+	if (cfg->io_thread_num_max < cfg->io_thread_num)
+		cfg->io_thread_num_max = cfg->io_thread_num;
+
+	if (cfg->nonblocking_io_thread_num_max < cfg->nonblocking_io_thread_num)
+		cfg->nonblocking_io_thread_num_max = cfg->nonblocking_io_thread_num;
+
 	if (!cfg->net_thread_num) {
 		cfg->net_thread_num = 1;
 		if (cfg->flags & DNET_CFG_JOIN_NETWORK)
 			cfg->net_thread_num = 8;
 	}
 
+	if (!cfg->net_event_num)
+		cfg->net_event_num = DNET_DEFAULT_NET_EVENT_NUM;
+
+	if (!cfg->net_recv_buffer_size)
+		cfg->net_recv_buffer_size = DNET_DEFAULT_NET_RECV_BUFFER_SIZE;
+
 	n = dnet_node_alloc(cfg);
 	if (!n) {
 		err = -ENOMEM;
@@ -562,6 +1001,33 @@ struct dnet_node *dnet_node_create(struct dnet_config *cfg)
 	n->removal_delay = cfg->removal_delay;
 	n->flags = cfg->flags;
 	n->cache_size = cfg->cache_size;
+	n->recv_buffer_size = (cfg->net_recv_buffer_size > 0) ? cfg->net_recv_buffer_size : 0;
+
+	/*
+	 * Only servers throttle their clients, client never stops reading replies
+	 */
+	if (cfg->flags & DNET_CFG_JOIN_NETWORK) {
+		if (!cfg->send_queue_limit)
+			cfg->send_queue_limit = DNET_DEFAULT_SEND_QUEUE_LIMIT;
+		if (!cfg->send_queue_global_limit)
+			cfg->send_queue_global_limit = DNET_DEFAULT_SEND_QUEUE_GLOBAL_LIMIT;
+
+		n->send_queue_limit = cfg->send_queue_limit;
+		n->send_queue_global_limit = cfg->send_queue_global_limit;
+	}
+
+	if (cfg->net_stripe_num > DNET_MAX_NET_STRIPE_NUM)
+		cfg->net_stripe_num = DNET_MAX_NET_STRIPE_NUM;
+	if (!cfg->net_stripe_large_size)
+		cfg->net_stripe_large_size = DNET_DEFAULT_NET_STRIPE_LARGE_SIZE;
+
+	n->stripe_num = cfg->net_stripe_num;
+	n->stripe_large_size = cfg->net_stripe_large_size;
+
+	if (cfg->bulk_write_window <= 0)
+		cfg->bulk_write_window = DNET_DEFAULT_BULK_WRITE_WINDOW;
+	n->bulk_write_window = cfg->bulk_write_window;
+	n->hedged_read_delay = cfg->hedged_read_delay;
 
 	if (strlen(cfg->temp_meta_env))
 		n->temp_meta_env = cfg->temp_meta_env;
@@ -646,6 +1112,8 @@ void dnet_node_cleanup_common_resources(struct dnet_node *n)
 
 	pthread_attr_destroy(&n->attr);
 
+	dnet_route_cleanup(n);
+	pthread_mutex_destroy(&n->route_sync_lock);
 	pthread_mutex_destroy(&n->state_lock);
 	dnet_crypto_cleanup(n);
 
@@ -703,3 +1171,8 @@ void dnet_set_timeouts(struct dnet_node *n, int wait_timeout, int check_timeout)
 	n->wait_ts.tv_sec = wait_timeout;
 	n->check_timeout = check_timeout;
 }
+
+int dnet_get_wait_timeout(struct dnet_node *n)
+{
+	return n->wait_ts.tv_sec;
+}
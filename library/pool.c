@@ -15,6 +15,7 @@
 
 #include <sys/stat.h>
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -37,6 +38,240 @@ static char *dnet_work_io_mode_str(int mode)
 	return dnet_work_io_mode_string[mode];
 }
 
+/*
+ * Pick a thread to queue request to: the first idle thread starting from
+ * rotating position, or thread at that position if everyone is busy.
+ * Idle flag is read without lock, it is only a hint - thread rechecks its
+ * queue under the lock before going to sleep, and sleeping thread is
+ * always signalled when request is queued to it.
+ *
+ * When pool spans several NUMA nodes, threads from the node of the network
+ * thread which received the request are preferred, idle one first.
+ */
+static struct dnet_work_io *dnet_work_pool_pick(struct dnet_work_pool *pool, int node)
+{
+	int num = pool->num;
+	int pos = (unsigned int)atomic_inc(&pool->pos) % num;
+	struct dnet_work_io *idle = NULL, *local = NULL;
+	int i;
+
+	if (!pool->numa)
+		node = -1;
+
+	for (i = 0; i < num; ++i) {
+		struct dnet_work_io *wio = &pool->wio[(pos + i) % num];
+
+		if (wio->node == node) {
+			if (wio->idle)
+				return wio;
+			if (!local)
+				local = wio;
+		}
+
+		if (wio->idle && !idle) {
+			idle = wio;
+			if (node < 0)
+				break;
+		}
+	}
+
+	if (idle)
+		return idle;
+	if (local)
+		return local;
+
+	return &pool->wio[pos];
+}
+
+/*
+ * Pool times are averages of per-thread running averages over running threads,
+ * every thread updates only its own ones, so they are read without locking
+ */
+static void dnet_work_pool_time(struct dnet_work_pool *pool, long *wait_time, long *handle_time)
+{
+	int i, num = pool->num;
+
+	*wait_time = *handle_time = 0;
+	if (num <= 0)
+		return;
+
+	for (i = 0; i < num; ++i) {
+		*wait_time += pool->wio[i].wait_time;
+		*handle_time += pool->wio[i].handle_time;
+	}
+
+	*wait_time /= num;
+	*handle_time /= num;
+}
+
+/*
+ * Starts one more thread unless pool is already at its maximum.
+ * It is called from request processing paths, so it does not wait
+ * when someone else is resizing the pool right now.
+ */
+static void dnet_work_pool_grow(struct dnet_work_pool *pool)
+{
+	struct dnet_node *n = pool->n;
+	struct dnet_work_io *wio;
+	long wait_time, handle_time;
+	int err;
+
+	if (pool->num >= pool->max)
+		return;
+
+	if (pthread_mutex_trylock(&pool->lock))
+		return;
+
+	if (pool->num >= pool->max || n->need_exit)
+		goto err_out_unlock;
+
+	wio = &pool->wio[pool->num];
+	if (wio->joinable) {
+		pthread_join(wio->tid, NULL);
+		wio->joinable = 0;
+	}
+
+	/* new thread starts with pool averages, not with stale ones of the previous thread in this slot */
+	dnet_work_pool_time(pool, &wait_time, &handle_time);
+	wio->wait_time = wait_time;
+	wio->handle_time = handle_time;
+
+	pthread_mutex_lock(&wio->lock);
+	wio->exited = 0;
+	pthread_mutex_unlock(&wio->lock);
+
+	err = pthread_create(&wio->tid, NULL, pool->process, wio);
+	if (err) {
+		pthread_mutex_lock(&wio->lock);
+		wio->exited = 1;
+		pthread_mutex_unlock(&wio->lock);
+
+		dnet_log(n, DNET_LOG_ERROR, "%s: failed to start IO thread: %d\n",
+				dnet_work_io_mode_str(pool->mode), -err);
+		goto err_out_unlock;
+	}
+
+	wio->joinable = 1;
+	pool->num++;
+
+	dnet_log(n, DNET_LOG_INFO, "%s: IO pool grows to %d threads: queued: %d, active: %d, wait: %ld usecs, handle: %ld usecs\n",
+			dnet_work_io_mode_str(pool->mode), pool->num, atomic_read(&pool->queued), atomic_read(&pool->active),
+			wait_time, handle_time);
+
+err_out_unlock:
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Only the last running thread may leave the pool, so running threads always
+ * occupy the lowest indexes. Thread is marked as exited under its queue lock,
+ * so nobody can queue request to it after it checked that its queue is empty.
+ */
+static int dnet_work_io_exit(struct dnet_work_io *wio)
+{
+	struct dnet_work_pool *pool = wio->pool;
+	int exited = 0;
+
+	if (pthread_mutex_trylock(&pool->lock))
+		return 0;
+
+	pthread_mutex_lock(&wio->lock);
+	if ((wio->thread_index == pool->num - 1) && (pool->num > pool->min) && list_empty(&wio->list)) {
+		wio->exited = 1;
+		pool->num--;
+		exited = 1;
+	}
+	pthread_mutex_unlock(&wio->lock);
+
+	if (exited)
+		dnet_log(pool->n, DNET_LOG_INFO, "%s: IO pool shrinks to %d threads\n",
+				dnet_work_io_mode_str(pool->mode), pool->num);
+
+	pthread_mutex_unlock(&pool->lock);
+	return exited;
+}
+
+static void dnet_work_pool_queue(struct dnet_work_pool *pool, struct dnet_io_req *r)
+{
+	struct dnet_work_io *wio;
+	int idle;
+
+	gettimeofday(&r->queue_time, NULL);
+
+	/* the first thread never leaves the pool */
+	if (pool->shared) {
+		wio = &pool->wio[0];
+
+		pthread_mutex_lock(&wio->lock);
+		list_add_tail(&r->req_entry, &wio->list);
+		atomic_inc(&pool->queued);
+		pthread_cond_broadcast(&wio->wait);
+		pthread_mutex_unlock(&wio->lock);
+
+		if (atomic_read(&pool->queued) > pool->num)
+			dnet_work_pool_grow(pool);
+		return;
+	}
+
+	/*
+	 * Picked thread may have just left the pool, pick again then
+	 */
+	while (1) {
+		wio = dnet_work_pool_pick(pool, r->st->numa_node);
+
+		pthread_mutex_lock(&wio->lock);
+		if (!wio->exited)
+			break;
+		pthread_mutex_unlock(&wio->lock);
+	}
+
+	list_add_tail(&r->req_entry, &wio->list);
+	atomic_inc(&pool->queued);
+
+	idle = wio->idle;
+	if (idle)
+		pthread_cond_signal(&wio->wait);
+	pthread_mutex_unlock(&wio->lock);
+
+	if (!idle && atomic_read(&pool->queued) > pool->num)
+		dnet_work_pool_grow(pool);
+}
+
+static void dnet_work_pool_stat_add(struct dnet_work_pool *pool, struct dnet_work_pool_stat *st)
+{
+	long wait_time, handle_time;
+
+	st->queued += atomic_read(&pool->queued);
+	st->active += atomic_read(&pool->active);
+	st->threads += pool->num;
+
+	dnet_work_pool_time(pool, &wait_time, &handle_time);
+	if ((unsigned long long)wait_time > st->wait_time)
+		st->wait_time = wait_time;
+	if ((unsigned long long)handle_time > st->handle_time)
+		st->handle_time = handle_time;
+}
+
+/*
+ * Nonblocking statistics cover both pools which run nonblocking_io_thread_num threads
+ */
+void dnet_work_pool_stat(struct dnet_node *n, int nonblocking, struct dnet_work_pool_stat *st)
+{
+	struct dnet_io *io = n->io;
+
+	memset(st, 0, sizeof(struct dnet_work_pool_stat));
+
+	if (!io)
+		return;
+
+	if (nonblocking) {
+		dnet_work_pool_stat_add(io->recv_pool_nb, st);
+		dnet_work_pool_stat_add(io->recv_pool_eblock, st);
+	} else {
+		dnet_work_pool_stat_add(io->recv_pool, st);
+	}
+}
+
 static void dnet_schedule_io(struct dnet_node *n, struct dnet_io_req *r)
 {
 	struct dnet_io *io = n->io;
@@ -69,10 +304,151 @@ static void dnet_schedule_io(struct dnet_node *n, struct dnet_io_req *r)
 			pool = io->recv_pool_eblock;
 	}
 
-	pthread_mutex_lock(&pool->lock);
-	list_add_tail(&r->req_entry, &pool->list);
-	pthread_cond_broadcast(&pool->wait);
-	pthread_mutex_unlock(&pool->lock);
+	dnet_work_pool_queue(pool, r);
+}
+
+static int dnet_io_req_pool_init(struct dnet_io_req_pool *p)
+{
+	int err, i;
+
+	memset(p, 0, sizeof(struct dnet_io_req_pool));
+
+	err = pthread_mutex_init(&p->lock, NULL);
+	if (err)
+		return -err;
+
+	for (i=0; i<DNET_IO_REQ_POOL_CLASSES; ++i) {
+		INIT_LIST_HEAD(&p->free[i]);
+		INIT_LIST_HEAD(&p->returned[i]);
+		atomic_init(&p->free_num[i], 0);
+	}
+
+	return 0;
+}
+
+static void dnet_io_req_pool_free_list(struct list_head *head)
+{
+	struct dnet_io_req *r, *tmp;
+
+	list_for_each_entry_safe(r, tmp, head, req_entry) {
+		list_del(&r->req_entry);
+		free(r);
+	}
+}
+
+static void dnet_io_req_pool_cleanup(struct dnet_io_req_pool *p)
+{
+	int i;
+
+	for (i=0; i<DNET_IO_REQ_POOL_CLASSES; ++i) {
+		dnet_io_req_pool_free_list(&p->free[i]);
+		dnet_io_req_pool_free_list(&p->returned[i]);
+	}
+
+	pthread_mutex_destroy(&p->lock);
+}
+
+static inline size_t dnet_io_req_pool_class_size(int class)
+{
+	return DNET_IO_REQ_POOL_MIN_SIZE << (class * 2);
+}
+
+static inline int dnet_io_req_pool_class_num(int class)
+{
+	return DNET_IO_REQ_POOL_CACHE_SIZE / dnet_io_req_pool_class_size(class);
+}
+
+/*
+ * Allocates receive request with @size bytes of header and data following it.
+ * Must only be called from the network thread which owns @p.
+ */
+static struct dnet_io_req *dnet_io_req_pool_get(struct dnet_io_req_pool *p, uint64_t size)
+{
+	struct dnet_io_req *r = NULL;
+	int class;
+
+	size += sizeof(struct dnet_io_req);
+
+	for (class = 0; class < DNET_IO_REQ_POOL_CLASSES; ++class) {
+		if (size <= dnet_io_req_pool_class_size(class))
+			break;
+	}
+
+	if (!p || class == DNET_IO_REQ_POOL_CLASSES) {
+		r = malloc(size);
+		if (!r)
+			return NULL;
+
+		if (p)
+			p->miss++;
+
+		memset(r, 0, sizeof(struct dnet_io_req));
+		return r;
+	}
+
+	if (list_empty(&p->free[class]) && !list_empty_careful(&p->returned[class])) {
+		pthread_mutex_lock(&p->lock);
+		list_splice_init(&p->returned[class], &p->free[class]);
+		atomic_add(&p->free_num[class], p->returned_num[class]);
+		p->returned_num[class] = 0;
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	if (!list_empty(&p->free[class])) {
+		r = list_first_entry(&p->free[class], struct dnet_io_req, req_entry);
+		list_del(&r->req_entry);
+		atomic_dec(&p->free_num[class]);
+		p->hit++;
+	} else {
+		r = malloc(dnet_io_req_pool_class_size(class));
+		if (!r)
+			return NULL;
+		p->miss++;
+	}
+
+	memset(r, 0, sizeof(struct dnet_io_req));
+	r->pool = p;
+	r->pool_class = class;
+
+	return r;
+}
+
+/*
+ * Returns request to the pool it was allocated from, can be called from any thread.
+ * Buffers above per-class cache limit are freed. Network thread only moves buffers
+ * between lists under @p->lock or takes them from @free list, so the sum checked here
+ * can only decrease until the lock is dropped.
+ */
+void dnet_io_req_pool_put(struct dnet_io_req *r)
+{
+	struct dnet_io_req_pool *p = r->pool;
+	int class = r->pool_class;
+
+	pthread_mutex_lock(&p->lock);
+	if (atomic_read(&p->free_num[class]) + p->returned_num[class] < dnet_io_req_pool_class_num(class)) {
+		list_add(&r->req_entry, &p->returned[class]);
+		p->returned_num[class]++;
+		r = NULL;
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	free(r);
+}
+
+void dnet_io_req_pool_stat(struct dnet_node *n, unsigned long long *hit, unsigned long long *miss)
+{
+	struct dnet_io *io = n->io;
+	int i;
+
+	*hit = *miss = 0;
+
+	if (!io)
+		return;
+
+	for (i=0; i<io->net_thread_num; ++i) {
+		*hit += io->net[i].rcv_pool.hit;
+		*miss += io->net[i].rcv_pool.miss;
+	}
 }
 
 void dnet_schedule_command(struct dnet_net_state *st)
@@ -86,7 +462,7 @@ void dnet_schedule_command(struct dnet_net_state *st)
 		dnet_log(st->n, DNET_LOG_DEBUG, "freed: size: %llu, trans: %llu, reply: %d, ptr: %p.\n",
 						(unsigned long long)c->size, tid, tid != c->trans, st->rcv_data);
 #endif
-		free(st->rcv_data);
+		dnet_io_req_free(st->rcv_data);
 		st->rcv_data = NULL;
 	}
 
@@ -94,14 +470,77 @@ void dnet_schedule_command(struct dnet_net_state *st)
 	st->rcv_offset = 0;
 }
 
+static int dnet_state_recv(struct dnet_net_state *st, void *data, uint64_t size)
+{
+	struct dnet_node *n = st->n;
+	int err;
+
+	/* io_uring engine receives into @st->rcv_buf itself, see dnet_uring_harvest() */
+	if (st->uring && dnet_uring_recv_async(st))
+		return -EAGAIN;
+
+	err = recv(st->read_s, data, size, 0);
+	if (err < 0) {
+		err = -EAGAIN;
+		if (errno != EAGAIN && errno != EINTR) {
+			err = -errno;
+			dnet_log_err(n, "failed to receive data, socket: %d", st->read_s);
+		}
+
+		return err;
+	}
+
+	if (err == 0) {
+		dnet_log(n, DNET_LOG_ERROR, "Peer %s has disconnected.\n",
+			dnet_server_convert_dnet_addr(&st->addr));
+		return -ECONNRESET;
+	}
+
+	st->io_bytes += err;
+	return err;
+}
+
+/*
+ * Returns non-zero if receive buffer holds data which can be parsed without reading socket,
+ * such state will not be reported by epoll/io_uring again and has to be processed anyway.
+ */
+static inline int dnet_state_rcv_buffered(struct dnet_net_state *st)
+{
+	size_t avail = st->rcv_buf_end - st->rcv_buf_start;
+
+	if (st->rcv_flags & DNET_IO_CMD)
+		return avail >= st->rcv_end - st->rcv_offset;
+
+	return avail != 0;
+}
+
+int dnet_state_rcv_buf_alloc(struct dnet_net_state *st)
+{
+	struct dnet_node *n = st->n;
+
+	if (!st->rcv_buf && n->recv_buffer_size) {
+		st->rcv_buf = malloc(n->recv_buffer_size);
+		if (!st->rcv_buf)
+			return -ENOMEM;
+
+		st->rcv_buf_size = n->recv_buffer_size;
+	}
+
+	return 0;
+}
+
 static int dnet_process_recv_single(struct dnet_net_state *st)
 {
 	struct dnet_node *n = st->n;
 	struct dnet_io_req *r;
 	void *data;
-	uint64_t size;
+	uint64_t size, avail;
 	int err;
 
+	err = dnet_state_rcv_buf_alloc(st);
+	if (err)
+		goto out;
+
 again:
 	/*
 	 * Reading command first.
@@ -114,26 +553,40 @@ again:
 	size = st->rcv_end - st->rcv_offset;
 
 	if (size) {
-		err = recv(st->read_s, data, size, 0);
-		if (err < 0) {
-			err = -EAGAIN;
-			if (errno != EAGAIN && errno != EINTR) {
-				err = -errno;
-				dnet_log_err(n, "failed to receive data, socket: %d", st->read_s);
+		avail = st->rcv_buf_end - st->rcv_buf_start;
+
+		if (avail) {
+			/*
+			 * Parse what was already read ahead.
+			 */
+			if (avail > size)
+				avail = size;
+
+			memcpy(data, st->rcv_buf + st->rcv_buf_start, avail);
+			st->rcv_buf_start += avail;
+			st->rcv_offset += avail;
+		} else if (size < st->rcv_buf_size) {
+			/*
+			 * Buffer is empty here, so read as much as fits into it,
+			 * it may contain several small commands at once.
+			 */
+			st->rcv_buf_start = st->rcv_buf_end = 0;
+
+			err = dnet_state_recv(st, st->rcv_buf, st->rcv_buf_size);
+			if (err < 0)
 				goto out;
-			}
 
-			goto out;
-		}
+			st->rcv_buf_end = err;
+		} else {
+			/*
+			 * Large payload is read directly into its own request buffer.
+			 */
+			err = dnet_state_recv(st, data, size);
+			if (err < 0)
+				goto out;
 
-		if (err == 0) {
-			dnet_log(n, DNET_LOG_ERROR, "Peer %s has disconnected.\n",
-				dnet_server_convert_dnet_addr(&st->addr));
-			err = -ECONNRESET;
-			goto out;
+			st->rcv_offset += err;
 		}
-
-		st->rcv_offset += err;
 	}
 
 	if (st->rcv_offset != st->rcv_end)
@@ -153,12 +606,11 @@ again:
 				!!(c->trans & DNET_TRANS_REPLY),
 				(unsigned long long)c->size, (unsigned long long)c->flags, c->status);
 
-		r = malloc(c->size + sizeof(struct dnet_cmd) + sizeof(struct dnet_io_req));
+		r = dnet_io_req_pool_get(st->rcv_pool, c->size + sizeof(struct dnet_cmd));
 		if (!r) {
 			err = -ENOMEM;
 			goto out;
 		}
-		memset(r, 0, sizeof(struct dnet_io_req));
 
 		r->header = r + 1;
 		r->hsize = sizeof(struct dnet_cmd);
@@ -200,7 +652,7 @@ out:
 int dnet_state_accept_process(struct dnet_net_state *orig, struct epoll_event *ev __unused)
 {
 	struct dnet_node *n = orig->n;
-	int err, cs;
+	int err, cs, net_thread;
 	struct dnet_addr addr;
 	struct dnet_net_state *st;
 
@@ -217,7 +669,13 @@ int dnet_state_accept_process(struct dnet_net_state *orig, struct epoll_event *e
 
 	dnet_set_sockopt(cs);
 
-	st = dnet_state_create(n, 0, NULL, 0, &addr, cs, &err, 0, dnet_state_net_process);
+	/*
+	 * Every network thread has its own listening socket in SO_REUSEPORT mode,
+	 * kernel balances connections between them and they are served where accepted.
+	 */
+	net_thread = (n->flags & DNET_CFG_REUSEPORT) ? orig->net_thread : -1;
+
+	st = dnet_state_create_thread(n, 0, NULL, 0, &addr, cs, &err, 0, dnet_state_net_process, net_thread);
 	if (!st) {
 		dnet_log(n, DNET_LOG_ERROR, "%s: Failed to create state for accepted client: %s [%d]\n",
 				dnet_server_convert_dnet_addr(&addr), strerror(-err), -err);
@@ -238,6 +696,11 @@ void dnet_unschedule_send(struct dnet_net_state *st)
 {
 	struct epoll_event ev;
 
+	if (st->uring) {
+		dnet_uring_unschedule(st, DNET_URING_SEND);
+		return;
+	}
+
 	ev.events = EPOLLOUT;
 	ev.data.ptr = st;
 
@@ -248,47 +711,25 @@ void dnet_unschedule_recv(struct dnet_net_state *st)
 {
 	struct epoll_event ev;
 
+	if (st->uring) {
+		dnet_uring_unschedule(st, DNET_URING_RECV);
+		return;
+	}
+
 	ev.events = EPOLLIN;
 	ev.data.ptr = st;
 
 	epoll_ctl(st->epoll_fd, EPOLL_CTL_DEL, st->read_s, &ev);
 }
 
-static int dnet_process_send_single(struct dnet_net_state *st)
-{
-	struct dnet_io_req *r = NULL;
-	int err;
-
-	while (1) {
-		r = NULL;
-
-		pthread_mutex_lock(&st->send_lock);
-		if (!list_empty(&st->send_list)) {
-			r = list_first_entry(&st->send_list, struct dnet_io_req, req_entry);
-		} else {
-			dnet_unschedule_send(st);
-		}
-		pthread_mutex_unlock(&st->send_lock);
-
-		if (!r) {
-			err = -EAGAIN;
-			goto err_out_exit;
-		}
-
-		err = dnet_send_request(st, r);
-		if (err)
-			goto err_out_exit;
-	}
-
-err_out_exit:
-	return err;
-}
-
 static int dnet_schedule_network_io(struct dnet_net_state *st, int send)
 {
 	struct epoll_event ev;
 	int err, fd;
 
+	if (st->uring)
+		return dnet_uring_schedule(st, send ? DNET_URING_SEND : DNET_URING_RECV);
+
 	if (send) {
 		ev.events = EPOLLOUT;
 		fd = st->write_s;
@@ -327,12 +768,15 @@ int dnet_state_net_process(struct dnet_net_state *st, struct epoll_event *ev)
 	int err = -ECONNRESET;
 
 	if (ev->events & EPOLLIN) {
-		err = dnet_process_recv_single(st);
+		/* client which does not read its replies is not read either */
+		err = -EAGAIN;
+		if (!st->send_throttled)
+			err = dnet_process_recv_single(st);
 		if (err && (err != -EAGAIN))
 			goto err_out_exit;
 	}
 	if (ev->events & EPOLLOUT) {
-		err = dnet_process_send_single(st);
+		err = dnet_send_list(st);
 		if (err && (err != -EAGAIN))
 			goto err_out_exit;
 	}
@@ -345,88 +789,258 @@ err_out_exit:
 	return err;
 }
 
-static void *dnet_io_process_network(void *data_)
+static void dnet_io_check_timeout(struct dnet_net_state *st, uint64_t now)
 {
-	struct dnet_net_io *nio = data_;
-	struct dnet_node *n = nio->n;
-	struct dnet_net_state *st;
-	struct epoll_event ev;
-	int err = 0, check;
 	struct dnet_trans *t, *tmp;
-	struct timeval tv;
 	struct list_head head;
 
-	dnet_set_name("net_pool");
+	INIT_LIST_HEAD(&head);
 
-	while (!n->need_exit) {
-		err = epoll_wait(nio->epoll_fd, &ev, 1, 1000);
-		if (err == 0)
-			continue;
+	pthread_mutex_lock(&st->trans_lock);
+	dnet_wheel_advance(&st->trans_wheel, now, &st->trans_timeout_list);
+	list_splice_init(&st->trans_timeout_list, &head);
 
-		if (err < 0) {
-			err = -errno;
+	list_for_each_entry(t, &head, timer.entry)
+		dnet_trans_remove_nolock(&st->trans_table, t);
+	pthread_mutex_unlock(&st->trans_lock);
 
-			if (err == -EAGAIN || err == -EINTR)
-				continue;
+	list_for_each_entry_safe(t, tmp, &head, timer.entry) {
+		dnet_wheel_del(&t->timer);
 
-			dnet_log_err(n, "Failed to wait for IO fds");
-			n->need_exit = err;
-			break;
+		t->cmd.flags = 0;
+		t->cmd.size = 0;
+		t->cmd.status = -ETIMEDOUT;
+
+		dnet_log(st->n, DNET_LOG_ERROR, "%s: destructing trans: %llu on TIMEOUT\n",
+				dnet_state_dump_addr(st), (unsigned long long)t->trans);
+
+		if (t->complete)
+			t->complete(st, &t->cmd, t->priv);
+
+		dnet_trans_put(t);
+	}
+}
+
+/*
+ * Drop references held by every harvested event which points to given state.
+ * It is called when state was reset in the middle of the batch, so that it is
+ * neither processed nor checked for timeouts anymore, and when batch is completed.
+ */
+static void dnet_io_put_state_events(struct dnet_net_io *nio, int num, struct dnet_net_state *st)
+{
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		if (nio->events[i].data.ptr == st) {
+			nio->events[i].data.ptr = NULL;
+			nio->budget[i] = 0;
+
+			dnet_state_put(st);
+		}
+	}
+}
+
+/*
+ * Parses CPU list like "0-3,8,10-11" into array of CPU numbers,
+ * returns number of CPUs in the list or negative error.
+ */
+static int dnet_cpu_list_parse(struct dnet_node *n, const char *list, int *cpus, int max)
+{
+	const char *p = list;
+	char *end;
+	long first, last;
+	int num = 0;
+
+	while (*p) {
+		if (*p == ',' || isspace(*p)) {
+			p++;
+			continue;
+		}
+
+		first = last = strtol(p, &end, 10);
+		if (end == p)
+			goto err_out_inval;
+
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				goto err_out_inval;
 		}
 
-		st = ev.data.ptr;
+		if (first < 0 || last < first || last >= DNET_CPU_MAX)
+			goto err_out_inval;
+
+		for (; first <= last && num < max; ++first)
+			cpus[num++] = first;
+
+		p = end;
+	}
+
+	return num;
+
+err_out_inval:
+	dnet_log(n, DNET_LOG_ERROR, "Invalid CPU list '%s'\n", list);
+	return -EINVAL;
+}
+
+static void dnet_io_bind_cpu(struct dnet_node *n, int cpu)
+{
+	int err;
+
+	if (cpu < 0)
+		return;
+
+	err = dnet_set_cpu(cpu);
+	if (err)
+		dnet_log(n, DNET_LOG_ERROR, "Failed to bind thread to CPU %d: %d\n", cpu, err);
+}
+
+/*
+ * Read and write sockets of the same state are registered separately,
+ * so the same state may show up in the batch twice. Every event holds
+ * its own reference, since processing one of them may reset the state.
+ */
+static int dnet_io_wait_epoll(struct dnet_net_io *nio, int carry)
+{
+	struct dnet_net_state *st;
+	int num, i;
+
+	if (carry == nio->event_num)
+		return 0;
+
+	num = epoll_wait(nio->epoll_fd, nio->events + carry, nio->event_num - carry, carry ? 0 : 1000);
+	if (num < 0)
+		return -errno;
+
+	for (i = carry; i < carry + num; ++i) {
+		st = nio->events[i].data.ptr;
 		st->epoll_fd = nio->epoll_fd;
-		check = st->stall;
 
-		while (1) {
-			err = st->process(st, &ev);
-			if (err == 0)
-				continue;
+		dnet_state_get(st);
+		nio->budget[i] = DNET_DEFAULT_NET_STATE_BUDGET;
+	}
 
-			if (err == -EAGAIN && st->stall < DNET_DEFAULT_STALL_TRANSACTIONS)
-				break;
+	return num;
+}
 
-			if (err < 0 || st->stall >= DNET_DEFAULT_STALL_TRANSACTIONS) {
-				dnet_state_reset(st);
-				check = 0;
+/*
+ * Completed requests already carry state references, their budgets are set
+ * by dnet_uring_wait(), since data received by io_uring is charged there.
+ */
+static int dnet_io_wait_uring(struct dnet_net_io *nio, int carry)
+{
+	return dnet_uring_wait(nio, carry);
+}
+
+static void *dnet_io_process_network(void *data_)
+{
+	struct dnet_net_io *nio = data_;
+	struct dnet_node *n = nio->n;
+	struct dnet_net_state *st;
+	struct epoll_event *ev;
+	int err = 0, num, active, i, carry = 0;
+	uint64_t now, io_bytes;
+
+	dnet_set_name("net_pool");
+	dnet_io_bind_cpu(n, nio->cpu);
+
+	while (!n->need_exit) {
+		if (nio->uring)
+			num = dnet_io_wait_uring(nio, carry);
+		else
+			num = dnet_io_wait_epoll(nio, carry);
+		if (num < 0) {
+			err = num;
+
+			if (err != -EAGAIN && err != -EINTR) {
+				dnet_log(n, DNET_LOG_ERROR, "Failed to wait for IO fds: %d\n", err);
+				n->need_exit = err;
 				break;
 			}
+
+			num = 0;
 		}
 
-		if (!check)
+		num += carry;
+		carry = 0;
+
+		if (num == 0)
 			continue;
 
-		gettimeofday(&tv, NULL);
+		/*
+		 * Serve ready states round-robin: every pass processes single command
+		 * per state, until either state has nothing more to read/write or
+		 * it has exhausted its budget of received and sent bytes. Commands parsed
+		 * from already read data are not charged again. Epoll is level-triggered, so
+		 * the rest of the data will be reported by the next epoll_wait(),
+		 * io_uring requests are one-shot and are re-armed below.
+		 */
+		do {
+			active = 0;
 
-		INIT_LIST_HEAD(&head);
+			for (i = 0; i < num; ++i) {
+				if (nio->budget[i] <= 0)
+					continue;
 
-		pthread_mutex_lock(&st->trans_lock);
-		list_for_each_entry_safe(t, tmp, &st->trans_list, trans_list_entry) {
-			if (t->time.tv_sec >= tv.tv_sec)
-				break;
+				ev = &nio->events[i];
+				st = ev->data.ptr;
 
-			dnet_trans_remove_nolock(&st->trans_root, t);
-			list_move(&t->trans_list_entry, &head);
-		}
-		pthread_mutex_unlock(&st->trans_lock);
+				io_bytes = st->io_bytes;
 
-		list_for_each_entry_safe(t, tmp, &head, trans_list_entry) {
-			list_del_init(&t->trans_list_entry);
+				err = st->process(st, ev);
+				if (err == 0 && st->stall < DNET_DEFAULT_STALL_TRANSACTIONS) {
+					nio->budget[i] -= st->io_bytes - io_bytes;
+					if (nio->budget[i] > 0)
+						active++;
+					continue;
+				}
 
-			t->cmd.flags = 0;
-			t->cmd.size = 0;
-			t->cmd.status = -ETIMEDOUT;
+				nio->budget[i] = 0;
 
-			dnet_log(st->n, DNET_LOG_ERROR, "%s: destructing trans: %llu on TIMEOUT\n",
-					dnet_state_dump_addr(st), (unsigned long long)t->trans);
+				if (err == -EAGAIN && st->stall < DNET_DEFAULT_STALL_TRANSACTIONS)
+					continue;
+
+				dnet_state_reset(st);
+				dnet_io_put_state_events(nio, num, st);
+			}
+		} while (active);
 
-			if (t->complete)
-				t->complete(st, &t->cmd, t->priv);
+		now = dnet_wheel_ticks();
 
-			dnet_trans_put(t);
+		for (i = 0; i < num; ++i) {
+			st = nio->events[i].data.ptr;
+			if (!st)
+				continue;
+
+			if (st->stall)
+				dnet_io_check_timeout(st, now);
+
+			dnet_uring_rearm(st);
+
+			/*
+			 * Commands which are already in receive buffer will not be reported
+			 * by epoll/io_uring, such state is carried into the next batch.
+			 * Its events are dropped first, so @carry slot is never occupied by live event.
+			 */
+			if (dnet_state_rcv_buffered(st) && !st->send_throttled) {
+				dnet_state_get(st);
+				dnet_io_put_state_events(nio, num, st);
+
+				nio->events[carry].events = EPOLLIN;
+				nio->events[carry].data.ptr = st;
+				nio->budget[carry] = DNET_DEFAULT_NET_STATE_BUDGET;
+				carry++;
+				continue;
+			}
+
+			dnet_io_put_state_events(nio, num, st);
 		}
 	}
 
+	for (i = 0; i < carry; ++i)
+		dnet_state_put(nio->events[i].data.ptr);
+
 	return &n->need_exit;
 }
 
@@ -444,6 +1058,56 @@ struct dnet_io_process_data {
 	int thread_number;
 };
 
+static struct dnet_io_req *dnet_work_io_dequeue(struct dnet_work_io *wio)
+{
+	struct dnet_io_req *r = NULL;
+
+	if (!list_empty(&wio->list)) {
+		r = list_first_entry(&wio->list, struct dnet_io_req, req_entry);
+		list_del_init(&r->req_entry);
+		atomic_dec(&wio->pool->queued);
+	}
+
+	return r;
+}
+
+/*
+ * Take the oldest request from the first busy neighbour whose queue is not empty.
+ * Queues which are locked at the moment are skipped, there is no need to wait
+ * for them, since their owner is processing them right now.
+ * Neighbours from the same NUMA node are checked first.
+ */
+static struct dnet_io_req *dnet_work_io_steal(struct dnet_work_io *wio)
+{
+	struct dnet_work_pool *pool = wio->pool;
+	struct dnet_io_req *r = NULL;
+	int i, remote = 0, num = pool->num;
+
+again:
+	for (i = 1; i < num && !r; ++i) {
+		struct dnet_work_io *victim = &pool->wio[(wio->thread_index + i) % num];
+
+		if (pool->numa && ((victim->node != wio->node) != remote))
+			continue;
+
+		if (list_empty(&victim->list))
+			continue;
+
+		if (pthread_mutex_trylock(&victim->lock))
+			continue;
+
+		r = dnet_work_io_dequeue(victim);
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	if (!r && pool->numa && !remote) {
+		remote = 1;
+		goto again;
+	}
+
+	return r;
+}
+
 static void *dnet_io_process(void *data_)
 {
 	struct dnet_work_io *wio = data_;
@@ -451,45 +1115,69 @@ static void *dnet_io_process(void *data_)
 	struct dnet_node *n = pool->n;
 	struct dnet_net_state *st;
 	struct timespec ts;
-	struct timeval tv;
+	struct timeval tv, start;
 	struct dnet_io_req *r;
-	int err;
+	/* queue this thread takes requests from */
+	struct dnet_work_io *q = pool->shared ? &pool->wio[0] : wio;
+	int idle = 0;
+	long diff;
 
 	dnet_set_name("io_pool");
+	dnet_io_bind_cpu(n, wio->cpu);
 
 	while (!n->need_exit) {
-		r = NULL;
-		err = 0;
+		pthread_mutex_lock(&q->lock);
+		r = dnet_work_io_dequeue(q);
+		pthread_mutex_unlock(&q->lock);
 
-		gettimeofday(&tv, NULL);
-		ts.tv_sec = tv.tv_sec + 1;
-		ts.tv_nsec = tv.tv_usec * 1000;
+		if (!r && !pool->shared)
+			r = dnet_work_io_steal(wio);
 
-		pthread_mutex_lock(&pool->lock);
+		if (!r) {
+			gettimeofday(&tv, NULL);
+			ts.tv_sec = tv.tv_sec + 1;
+			ts.tv_nsec = tv.tv_usec * 1000;
+
+			pthread_mutex_lock(&q->lock);
+			r = dnet_work_io_dequeue(q);
+			if (!r) {
+				q->idle = 1;
+				pthread_cond_timedwait(&q->wait, &q->lock, &ts);
+				q->idle = 0;
+
+				r = dnet_work_io_dequeue(q);
+			}
+			pthread_mutex_unlock(&q->lock);
 
-		if (!list_empty(&pool->list)) {
-			r = list_first_entry(&pool->list, struct dnet_io_req, req_entry);
-		} else {
-			err = pthread_cond_timedwait(&pool->wait, &pool->lock, &ts);
-			if (!list_empty(&pool->list)) {
-				r = list_first_entry(&pool->list, struct dnet_io_req, req_entry);
-				err = 0;
+			if (!r) {
+				if (++idle >= DNET_WORK_IO_IDLE_EXIT && dnet_work_io_exit(wio))
+					break;
+				continue;
 			}
 		}
 
-		if (r)
-			list_del_init(&r->req_entry);
-		pthread_mutex_unlock(&pool->lock);
-
-		if (!r || err)
-			continue;
-
+		idle = 0;
 		st = r->st;
 
 		dnet_log(n, DNET_LOG_DEBUG, "%s: %s: got IO event: %p: hsize: %zu, dsize: %zu, mode: %s\n",
 			dnet_state_dump_addr(st), dnet_dump_id(r->header), r, r->hsize, r->dsize, dnet_work_io_mode_str(pool->mode));
 
-		err = dnet_process_recv(st, r);
+		/*
+		 * Requests which waited too long mean that every thread is blocked in the backend
+		 */
+		gettimeofday(&start, NULL);
+		diff = 1000000 * (start.tv_sec - r->queue_time.tv_sec) + (start.tv_usec - r->queue_time.tv_usec);
+		wio->wait_time += (diff - wio->wait_time) / (1 << DNET_WORK_IO_TIME_SHIFT);
+		if (diff > DNET_WORK_IO_WAIT_GROW && atomic_read(&pool->queued))
+			dnet_work_pool_grow(pool);
+
+		atomic_inc(&pool->active);
+		dnet_process_recv(st, r);
+		atomic_dec(&pool->active);
+
+		gettimeofday(&tv, NULL);
+		diff = 1000000 * (tv.tv_sec - start.tv_sec) + (tv.tv_usec - start.tv_usec);
+		wio->handle_time += (diff - wio->handle_time) / (1 << DNET_WORK_IO_TIME_SHIFT);
 
 		dnet_io_req_free(r);
 		dnet_state_put(st);
@@ -498,44 +1186,101 @@ static void *dnet_io_process(void *data_)
 	return NULL;
 }
 
-static void dnet_work_pool_cleanup(struct dnet_work_pool *pool)
+static void dnet_work_io_cleanup(struct dnet_work_io *wio)
 {
 	struct dnet_io_req *r, *tmp;
-	int i;
 
-	for (i = 0; i < pool->num; ++i) {
+	list_for_each_entry_safe(r, tmp, &wio->list, req_entry) {
+		list_del(&r->req_entry);
+		dnet_io_req_free(r);
+	}
+
+	pthread_cond_destroy(&wio->wait);
+	pthread_mutex_destroy(&wio->lock);
+}
+
+static void dnet_work_pool_cleanup(struct dnet_work_pool *pool)
+{
+	int i, max = pool->max;
+
+	/* no new threads from now on */
+	pthread_mutex_lock(&pool->lock);
+	pool->max = 0;
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < max; ++i) {
 		struct dnet_work_io *wio = &pool->wio[i];
 
-		pthread_join(wio->tid, NULL);
+		if (wio->joinable)
+			pthread_join(wio->tid, NULL);
 	}
 
-	list_for_each_entry_safe(r, tmp, &pool->list, req_entry) {
-		list_del(&r->req_entry);
-		dnet_io_req_free(r);
-	}
+	for (i = 0; i < max; ++i)
+		dnet_work_io_cleanup(&pool->wio[i]);
 
-	pthread_cond_destroy(&pool->wait);
 	pthread_mutex_destroy(&pool->lock);
 	free(pool);
 }
 
-static struct dnet_work_pool *dnet_work_pool_alloc(struct dnet_node *n, int num, int mode, void *(* process)(void *))
+static int dnet_work_io_init(struct dnet_work_pool *pool, int idx, int cpu)
+{
+	struct dnet_work_io *wio = &pool->wio[idx];
+	int err;
+
+	wio->thread_index = idx;
+	wio->pool = pool;
+	INIT_LIST_HEAD(&wio->list);
+
+	wio->cpu = cpu;
+	wio->node = (cpu >= 0) ? dnet_cpu_node(cpu) : -1;
+	if (wio->node != pool->wio[0].node)
+		pool->numa = 1;
+
+	err = pthread_mutex_init(&wio->lock, NULL);
+	if (err)
+		return -err;
+
+	err = pthread_cond_init(&wio->wait, NULL);
+	if (err) {
+		pthread_mutex_destroy(&wio->lock);
+		return -err;
+	}
+
+	return 0;
+}
+
+static struct dnet_work_pool *dnet_work_pool_alloc(struct dnet_node *n, int num, int max, int mode,
+		const char *cpu_list, void *(* process)(void *))
 {
 	struct dnet_work_pool *pool;
-	int err, i;
+	int cpus[DNET_CPU_MAX];
+	int err, i, cpu_num;
+
+	cpu_num = dnet_cpu_list_parse(n, cpu_list, cpus, DNET_CPU_MAX);
+	if (cpu_num < 0)
+		goto err_out_exit;
 
-	pool = malloc(sizeof(struct dnet_work_pool) + num * sizeof(struct dnet_work_io));
+	if (max < num)
+		max = num;
+
+	pool = malloc(sizeof(struct dnet_work_pool) + max * sizeof(struct dnet_work_io));
 	if (!pool) {
 		err = -ENOMEM;
 		goto err_out_exit;
 	}
 
-	memset(pool, 0, sizeof(struct dnet_work_pool) + num * sizeof(struct dnet_work_io));
+	memset(pool, 0, sizeof(struct dnet_work_pool) + max * sizeof(struct dnet_work_io));
 
 	pool->num = num;
+	pool->min = num;
+	pool->max = max;
 	pool->mode = mode;
+	pool->shared = !!(n->flags & DNET_CFG_IO_SHARED_QUEUE);
 	pool->n = n;
-	INIT_LIST_HEAD(&pool->list);
+	pool->process = process;
+	atomic_init(&pool->pos, 0);
+	atomic_init(&pool->queued, 0);
+	atomic_init(&pool->active, 0);
 
 	err = pthread_mutex_init(&pool->lock, NULL);
 	if (err) {
@@ -543,24 +1288,27 @@ static struct dnet_work_pool *dnet_work_pool_alloc(struct dnet_node *n, int num,
 		goto err_out_free;
 	}
 
-	err = pthread_cond_init(&pool->wait, NULL);
-	if (err) {
-		err = -err;
-		goto err_out_mutex_destroy;
+	for (i = 0; i < max; ++i) {
+		err = dnet_work_io_init(pool, i, cpu_num ? cpus[i % cpu_num] : -1);
+		if (err) {
+			dnet_log(n, DNET_LOG_ERROR, "Failed to initialize IO thread queue: %d\n", err);
+			goto err_out_io_cleanup;
+		}
+
+		pool->wio[i].exited = (i >= num);
 	}
 
 	for (i = 0; i < num; ++i) {
 		struct dnet_work_io *wio = &pool->wio[i];
 
-		wio->thread_index = i;
-		wio->pool = pool;
-
 		err = pthread_create(&wio->tid, NULL, process, wio);
 		if (err) {
 			err = -err;
 			dnet_log(n, DNET_LOG_ERROR, "Failed to create IO thread: %d\n", err);
 			goto err_out_io_threads;
 		}
+
+		wio->joinable = 1;
 	}
 
 	return pool;
@@ -570,8 +1318,10 @@ err_out_io_threads:
 		struct dnet_work_io *wio = &pool->wio[i];
 		pthread_join(wio->tid, NULL);
 	}
-	pthread_cond_destroy(&pool->wait);
-err_out_mutex_destroy:
+	i = max;
+err_out_io_cleanup:
+	while (--i >= 0)
+		dnet_work_io_cleanup(&pool->wio[i]);
 	pthread_mutex_destroy(&pool->lock);
 err_out_free:
 	free(pool);
@@ -582,8 +1332,17 @@ err_out_exit:
 int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 {
 	int err, i;
+	int uring = !!(cfg->flags & DNET_CFG_IO_URING);
 	struct dnet_io *io;
 	int io_size = sizeof(struct dnet_io) + sizeof(struct dnet_net_io) * cfg->net_thread_num;
+	int cpus[DNET_CPU_MAX];
+	int cpu_num;
+
+	cpu_num = dnet_cpu_list_parse(n, cfg->net_thread_cpus, cpus, DNET_CPU_MAX);
+	if (cpu_num < 0) {
+		err = cpu_num;
+		goto err_out_exit;
+	}
 
 	io = malloc(io_size);
 	if (!io) {
@@ -597,20 +1356,23 @@ int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 	io->net_thread_pos = 0;
 	io->net = (struct dnet_net_io *)(io + 1);
 
-	io->recv_pool = dnet_work_pool_alloc(n, cfg->io_thread_num, DNET_WORK_IO_MODE_BLOCKING, dnet_io_process);
+	io->recv_pool = dnet_work_pool_alloc(n, cfg->io_thread_num, cfg->io_thread_num_max, DNET_WORK_IO_MODE_BLOCKING,
+			cfg->io_thread_cpus, dnet_io_process);
 	if (!io->recv_pool) {
 		err = -ENOMEM;
 		goto err_out_free;
 	}
 
-	io->recv_pool_nb = dnet_work_pool_alloc(n, cfg->nonblocking_io_thread_num, DNET_WORK_IO_MODE_NONBLOCKING, dnet_io_process);
+	io->recv_pool_nb = dnet_work_pool_alloc(n, cfg->nonblocking_io_thread_num, cfg->nonblocking_io_thread_num_max,
+			DNET_WORK_IO_MODE_NONBLOCKING, cfg->nonblocking_io_thread_cpus, dnet_io_process);
 	if (!io->recv_pool_nb) {
 		err = -ENOMEM;
 		goto err_out_free_recv_pool;
 	}
 
-	io->recv_pool_eblock = dnet_work_pool_alloc(n, cfg->nonblocking_io_thread_num, DNET_WORK_IO_MODE_EXEC_BLOCKING, dnet_io_process);
-	if (!io->recv_pool_nb) {
+	io->recv_pool_eblock = dnet_work_pool_alloc(n, cfg->nonblocking_io_thread_num, cfg->nonblocking_io_thread_num_max,
+			DNET_WORK_IO_MODE_EXEC_BLOCKING, cfg->nonblocking_io_thread_cpus, dnet_io_process);
+	if (!io->recv_pool_eblock) {
 		err = -ENOMEM;
 		goto err_out_free_recv_pool_nb;
 	}
@@ -619,20 +1381,50 @@ int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 		struct dnet_net_io *nio = &io->net[i];
 
 		nio->n = n;
+		nio->event_num = cfg->net_event_num;
+
+		nio->cpu = cpu_num ? cpus[i % cpu_num] : -1;
+		nio->node = (nio->cpu >= 0) ? dnet_cpu_node(nio->cpu) : -1;
+
+		nio->events = malloc(nio->event_num * (sizeof(struct epoll_event) + sizeof(long)));
+		if (!nio->events) {
+			err = -ENOMEM;
+			goto err_out_net_destroy;
+		}
+		nio->budget = (long *)(nio->events + nio->event_num);
+
+		err = dnet_io_req_pool_init(&nio->rcv_pool);
+		if (err) {
+			free(nio->events);
+			goto err_out_net_destroy;
+		}
 
 		nio->epoll_fd = epoll_create(10000);
 		if (nio->epoll_fd < 0) {
 			err = -errno;
 			dnet_log_err(n, "Failed to create epoll fd");
+			dnet_io_req_pool_cleanup(&nio->rcv_pool);
+			free(nio->events);
 			goto err_out_net_destroy;
 		}
 
 		fcntl(nio->epoll_fd, F_SETFD, FD_CLOEXEC);
 		fcntl(nio->epoll_fd, F_SETFL, O_NONBLOCK);
 
+		if (uring) {
+			err = dnet_uring_init(nio);
+			if (err) {
+				dnet_log(n, DNET_LOG_ERROR, "Failed to initialize io_uring, falling back to epoll: %d\n", err);
+				uring = 0;
+			}
+		}
+
 		err = pthread_create(&nio->tid, NULL, dnet_io_process_network, nio);
 		if (err) {
+			dnet_uring_exit(nio);
 			close(nio->epoll_fd);
+			dnet_io_req_pool_cleanup(&nio->rcv_pool);
+			free(nio->events);
 			err = -err;
 			dnet_log(n, DNET_LOG_ERROR, "Failed to create network processing thread: %d\n", err);
 			goto err_out_net_destroy;
@@ -645,7 +1437,10 @@ int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 err_out_net_destroy:
 	while (--i >= 0) {
 		pthread_join(io->net[i].tid, NULL);
+		dnet_uring_exit(&io->net[i]);
 		close(io->net[i].epoll_fd);
+		dnet_io_req_pool_cleanup(&io->net[i].rcv_pool);
+		free(io->net[i].events);
 	}
 
 	dnet_work_pool_cleanup(io->recv_pool_eblock);
@@ -678,5 +1473,11 @@ void dnet_io_exit(struct dnet_node *n)
 
 	dnet_io_cleanup_states(n);
 
+	for (i=0; i<io->net_thread_num; ++i) {
+		dnet_uring_exit(&io->net[i]);
+		dnet_io_req_pool_cleanup(&io->net[i].rcv_pool);
+		free(io->net[i].events);
+	}
+
 	free(io);
 }
@@ -167,6 +167,38 @@ err_out_exit:
 	return err;
 }
 
+/*
+ * Opens listening socket bound to the same address for every network thread
+ * but the first one, which serves main server state. Listening states live
+ * in the empty state list and are reset together with all others on exit.
+ * Failure is not fatal, connections are accepted by fewer threads then.
+ */
+static void dnet_server_listen_reuseport(struct dnet_node *n)
+{
+	struct dnet_net_state *st;
+	int i, s, err = 0;
+
+	for (i = 1; i < n->io->net_thread_num; ++i) {
+		s = dnet_socket_create_addr(n, n->sock_type, n->proto, n->family,
+				(struct sockaddr *)n->addr.addr, n->addr.addr_len, 1);
+		if (s < 0) {
+			err = s;
+			break;
+		}
+
+		/* socket is closed on error */
+		st = dnet_state_create_thread(n, 0, NULL, 0, &n->addr, s, &err, 0, dnet_state_accept_process, i);
+		if (!st)
+			break;
+	}
+
+	if (err)
+		dnet_log(n, DNET_LOG_ERROR, "%s: opened %d listening sockets out of %d: %s [%d]\n",
+				dnet_dump_node(n), i, n->io->net_thread_num, strerror(-err), err);
+	else
+		dnet_log(n, DNET_LOG_INFO, "%s: opened %d listening sockets\n", dnet_dump_node(n), i);
+}
+
 struct dnet_node *dnet_server_node_create(struct dnet_config *cfg)
 {
 	struct dnet_node *n;
@@ -216,12 +248,16 @@ struct dnet_node *dnet_server_node_create(struct dnet_config *cfg)
 		s = err;
 		dnet_setup_id(&n->id, cfg->group_id, ids[0].id);
 
-		n->st = dnet_state_create(n, cfg->group_id, ids, id_num, &n->addr, s, &err, DNET_JOIN, dnet_state_accept_process);
+		n->st = dnet_state_create_thread(n, cfg->group_id, ids, id_num, &n->addr, s, &err, DNET_JOIN,
+				dnet_state_accept_process, (cfg->flags & DNET_CFG_REUSEPORT) ? 0 : -1);
 		if (!n->st) {
 			close(s);
 			goto err_out_state_destroy;
 		}
 
+		if (cfg->flags & DNET_CFG_REUSEPORT)
+			dnet_server_listen_reuseport(n);
+
 		free(ids);
 		ids = NULL;
 
@@ -26,53 +26,91 @@
 #include "elliptics/packet.h"
 #include "elliptics/interface.h"
 
-static inline int dnet_trans_cmp(uint64_t old, uint64_t new)
+int dnet_trans_table_init(struct dnet_trans_table *table, unsigned int size)
 {
-	if (old > new)
-		return 1;
-	if (old < new)
-		return -1;
+	unsigned int i;
+
+	table->buckets = malloc(size * sizeof(struct list_head));
+	if (!table->buckets)
+		return -ENOMEM;
+
+	for (i = 0; i < size; ++i)
+		INIT_LIST_HEAD(&table->buckets[i]);
+
+	table->mask = size - 1;
+	table->num = 0;
+
 	return 0;
 }
 
-struct dnet_trans *dnet_trans_search(struct rb_root *root, uint64_t trans)
+void dnet_trans_table_cleanup(struct dnet_trans_table *table)
+{
+	free(table->buckets);
+	table->buckets = NULL;
+}
+
+static inline struct list_head *dnet_trans_bucket(struct dnet_trans_table *table, uint64_t trans)
+{
+	return &table->buckets[trans & table->mask];
+}
+
+/*
+ * Doubles number of buckets, if allocation fails table keeps working with longer chains.
+ */
+static void dnet_trans_table_grow(struct dnet_trans_table *table)
 {
-	struct rb_node *n = root->rb_node;
-	struct dnet_trans *t = NULL;
-	int cmp = 1;
-
-	while (n) {
-		t = rb_entry(n, struct dnet_trans, trans_entry);
-
-		cmp = dnet_trans_cmp(t->trans, trans);
-		if (cmp < 0)
-			n = n->rb_left;
-		else if (cmp > 0)
-			n = n->rb_right;
-		else
+	struct dnet_trans_table tmp;
+	struct dnet_trans *t, *n;
+	unsigned int i;
+
+	if (dnet_trans_table_init(&tmp, (table->mask + 1) * 2))
+		return;
+
+	for (i = 0; i <= table->mask; ++i) {
+		list_for_each_entry_safe(t, n, &table->buckets[i], trans_entry)
+			list_move_tail(&t->trans_entry, dnet_trans_bucket(&tmp, t->trans));
+	}
+
+	tmp.num = table->num;
+
+	dnet_trans_table_cleanup(table);
+	*table = tmp;
+}
+
+struct dnet_trans *dnet_trans_search(struct dnet_trans_table *table, uint64_t trans)
+{
+	struct dnet_trans *t;
+
+	list_for_each_entry(t, dnet_trans_bucket(table, trans), trans_entry) {
+		if (t->trans == trans)
 			return dnet_trans_get(t);
 	}
 
 	return NULL;
 }
 
-int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a)
+struct dnet_trans *dnet_trans_first_nolock(struct dnet_trans_table *table)
 {
-	struct rb_node **n = &root->rb_node, *parent = NULL;
-	struct dnet_trans *t;
-	int cmp;
+	unsigned int i;
 
-	while (*n) {
-		parent = *n;
+	if (!table->num)
+		return NULL;
 
-		t = rb_entry(parent, struct dnet_trans, trans_entry);
+	for (i = 0; i <= table->mask; ++i) {
+		if (!list_empty(&table->buckets[i]))
+			return list_first_entry(&table->buckets[i], struct dnet_trans, trans_entry);
+	}
+
+	return NULL;
+}
+
+int dnet_trans_insert_nolock(struct dnet_trans_table *table, struct dnet_trans *a)
+{
+	struct list_head *head = dnet_trans_bucket(table, a->trans);
+	struct dnet_trans *t;
 
-		cmp = dnet_trans_cmp(t->trans, a->trans);
-		if (cmp < 0)
-			n = &parent->rb_left;
-		else if (cmp > 0)
-			n = &parent->rb_right;
-		else
+	list_for_each_entry(t, head, trans_entry) {
+		if (t->trans == a->trans)
 			return -EEXIST;
 	}
 
@@ -81,24 +119,24 @@ int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a)
 			dnet_dump_id(&a->cmd.id), (unsigned long long)a->trans,
 			dnet_server_convert_dnet_addr(&a->st->addr));
 
-	rb_link_node(&a->trans_entry, parent, n);
-	rb_insert_color(&a->trans_entry, root);
+	list_add_tail(&a->trans_entry, head);
+
+	if (++table->num > table->mask + 1)
+		dnet_trans_table_grow(table);
 	return 0;
 }
 
-void dnet_trans_remove_nolock(struct rb_root *root, struct dnet_trans *t)
+void dnet_trans_remove_nolock(struct dnet_trans_table *table, struct dnet_trans *t)
 {
-	if (!t->trans_entry.rb_parent_color) {
+	if (list_empty(&t->trans_entry)) {
 		if (t->st && t->st->n)
 			dnet_log(t->st->n, DNET_LOG_ERROR, "%s: trying to remove standalone transaction %llu.\n",
 				dnet_dump_id(&t->cmd.id), (unsigned long long)t->trans);
 		return;
 	}
 
-	if (t) {
-		rb_erase(&t->trans_entry, root);
-		t->trans_entry.rb_parent_color = 0;
-	}
+	list_del_init(&t->trans_entry);
+	table->num--;
 }
 
 void dnet_trans_remove(struct dnet_trans *t)
@@ -106,9 +144,60 @@ void dnet_trans_remove(struct dnet_trans *t)
 	struct dnet_net_state *st = t->st;
 
 	pthread_mutex_lock(&st->trans_lock);
-	dnet_trans_remove_nolock(&st->trans_root, t);
-	list_del_init(&t->trans_list_entry);
+	dnet_trans_remove_nolock(&st->trans_table, t);
+	dnet_wheel_del(&t->timer);
+	pthread_mutex_unlock(&st->trans_lock);
+}
+
+/*
+ * Read which has not been replied to within @diff usecs says that its state is at least that slow.
+ * Such censored sample only raises the estimate, otherwise replica which loses hedged reads
+ * (and thus always gets cancelled) would never lose its optimistic initial estimate.
+ */
+static void dnet_trans_read_time_censored(struct dnet_net_state *st, long diff)
+{
+	if (diff > st->median_read_time)
+		st->median_read_time += (diff - st->median_read_time) / (1 << DNET_STATE_READ_TIME_SHIFT);
+}
+
+/*
+ * Removes referenced transaction from its state, so that replies received later are dropped,
+ * and completes it with -ECANCELED status. Remote node still processes the request.
+ * Transaction which has been already completed or timed out is not touched.
+ */
+void dnet_trans_cancel(struct dnet_trans *t)
+{
+	struct dnet_net_state *st = t->st;
+	struct timeval tv;
+	long diff;
+	int found;
+
+	pthread_mutex_lock(&st->trans_lock);
+	found = !list_empty(&t->trans_entry);
+	if (found) {
+		dnet_trans_remove_nolock(&st->trans_table, t);
+		dnet_wheel_del(&t->timer);
+
+		t->cmd.flags = 0;
+		t->cmd.size = 0;
+		t->cmd.status = -ECANCELED;
+	}
 	pthread_mutex_unlock(&st->trans_lock);
+
+	if (found) {
+		/* elapsed time is accounted now, transaction may be destroyed much later */
+		if (t->rtt_st) {
+			gettimeofday(&tv, NULL);
+			diff = 1000000 * (tv.tv_sec - t->start.tv_sec) + (tv.tv_usec - t->start.tv_usec);
+			dnet_trans_read_time_censored(t->rtt_st, diff);
+		}
+
+		dnet_log(st->n, DNET_LOG_INFO, "%s: cancelled trans: %llu\n",
+				dnet_state_dump_addr(st), (unsigned long long)t->trans);
+
+		/* reference which was held by transaction table */
+		dnet_trans_put(t);
+	}
 }
 
 struct dnet_trans *dnet_trans_alloc(struct dnet_node *n __unused, uint64_t size)
@@ -122,7 +211,8 @@ struct dnet_trans *dnet_trans_alloc(struct dnet_node *n __unused, uint64_t size)
 	memset(t, 0, sizeof(struct dnet_trans) + size);
 
 	atomic_init(&t->refcnt, 1);
-	INIT_LIST_HEAD(&t->trans_list_entry);
+	INIT_LIST_HEAD(&t->trans_entry);
+	dnet_wheel_timer_init(&t->timer);
 
 	gettimeofday(&t->start, NULL);
 
@@ -148,12 +238,12 @@ void dnet_trans_destroy(struct dnet_trans *t)
 		st = t->st;
 
 		pthread_mutex_lock(&st->trans_lock);
-		list_del_init(&t->trans_list_entry);
+		dnet_wheel_del(&t->timer);
 		pthread_mutex_unlock(&st->trans_lock);
 
-		if (t->trans_entry.rb_parent_color)
+		if (!list_empty(&t->trans_entry))
 			dnet_trans_remove(t);
-	} else if (!list_empty(&t->trans_list_entry)) {
+	} else if (!list_empty(&t->timer.entry)) {
 		assert(0);
 	}
 
@@ -162,15 +252,19 @@ void dnet_trans_destroy(struct dnet_trans *t)
 		t->complete(t->st, &t->cmd, t->priv);
 	}
 
-	if (st && (t->cmd.status == 0) &&
-			((t->command == DNET_CMD_READ) || (t->command == DNET_CMD_LOOKUP))) {
+	if (t->rtt_st) {
+		struct dnet_net_state *rst = t->rtt_st;
 
-		if (diff < st->median_read_time && st->weight < DNET_STATE_MAX_WEIGHT)
-			st->weight *= 1.1;
-		else if (diff > st->median_read_time && st->weight > 1)
-			st->weight *= 0.8;
+		atomic_dec(&rst->reads_in_flight);
 
-		st->median_read_time = (st->median_read_time + diff) / 2;
+		/*
+		 * Failed requests only give a lower bound of the reply time, cancelled ones
+		 * have been accounted by dnet_trans_cancel()
+		 */
+		if (t->cmd.status == 0)
+			rst->median_read_time += (diff - rst->median_read_time) / (1 << DNET_STATE_READ_TIME_SHIFT);
+		else if (t->cmd.status != -ECANCELED)
+			dnet_trans_read_time_censored(rst, diff);
 	}
 
 	if (st && st->n && t->command != 0) {
@@ -186,7 +280,7 @@ void dnet_trans_destroy(struct dnet_trans *t)
 			(unsigned long long)(t->trans & ~DNET_TRANS_REPLY),
 			!!(t->trans & ~DNET_TRANS_REPLY),
 			dnet_state_dump_addr(t->st),
-			st->weight, st->median_read_time, diff,
+			st->weight, t->rtt_st ? t->rtt_st->median_read_time : st->median_read_time, diff,
 			str, t->start.tv_usec,
 			t->cmd.status);
 	}
@@ -194,6 +288,7 @@ void dnet_trans_destroy(struct dnet_trans *t)
 
 	dnet_state_put(t->st);
 	dnet_state_put(t->orig);
+	dnet_state_put(t->rtt_st);
 
 	free(t);
 }
@@ -282,16 +377,16 @@ err_out_exit:
 static void dnet_trans_check_stall(struct dnet_net_state *st)
 {
 	struct dnet_trans *t;
-	struct timeval tv;
 	int trans_timeout = 0;
 
-	gettimeofday(&tv, NULL);
-
+	/*
+	 * Expired transactions are only collected here, they are completed
+	 * by network thread once state is marked as stalled.
+	 */
 	pthread_mutex_lock(&st->trans_lock);
-	list_for_each_entry(t, &st->trans_list, trans_list_entry) {
-		if (t->time.tv_sec >= tv.tv_sec)
-			break;
+	dnet_wheel_advance(&st->trans_wheel, dnet_wheel_ticks(), &st->trans_timeout_list);
 
+	list_for_each_entry(t, &st->trans_timeout_list, timer.entry) {
 		dnet_log(st->n, DNET_LOG_ERROR, "%s: trans: %llu TIMEOUT\n", dnet_state_dump_addr(st), (unsigned long long)t->trans);
 		trans_timeout++;
 	}
@@ -311,7 +406,8 @@ static void dnet_trans_check_stall(struct dnet_net_state *st)
 
 			dnet_state_remove_nolock(st);
 		} else {
-			dnet_schedule_recv(st);
+			if (!st->send_throttled)
+				dnet_schedule_recv(st);
 			dnet_schedule_send(st);
 		}
 	} else {
@@ -331,14 +427,22 @@ static void dnet_check_all_states(struct dnet_node *n)
 {
 	struct dnet_net_state *st, *tmp;
 	struct dnet_group *g, *gtmp;
+	int i, num;
 
 	pthread_mutex_lock(&n->state_lock);
 	list_for_each_entry_safe(g, gtmp, &n->group_list, group_entry) {
 		list_for_each_entry_safe(st, tmp, &g->state_list, state_entry) {
 			dnet_trans_check_stall(st);
+
+			num = *(volatile int *)&st->stripe_num;
+			for (i = 0; i < num; ++i)
+				dnet_trans_check_stall(st->stripes[i]);
 		}
 	}
 	pthread_mutex_unlock(&n->state_lock);
+
+	/* stalled states have been removed from the route table */
+	dnet_route_reclaim(n);
 }
 
 static int dnet_check_route_table(struct dnet_node *n)
@@ -385,6 +489,7 @@ static void *dnet_check_process(void *data)
 
 	while (!n->need_exit) {
 		gettimeofday(&tv1, NULL);
+		dnet_state_stripes_open(n);
 		dnet_try_reconnect(n);
 		if (++checks == route_table_checks) {
 			checks = 0;
@@ -403,6 +508,9 @@ static void *dnet_check_process(void *data)
 				wait_for_stall = n->wait_ts.tv_sec;
 				dnet_check_all_states(n);
 			}
+
+			/* new states should not wait for the whole check timeout to get their stripes */
+			dnet_state_stripes_open(n);
 			sleep(1);
 		}
 	}
@@ -0,0 +1,993 @@
+/*
+ * 2012+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * io_uring network engine.
+ *
+ * Network thread does not wait for readiness and then call recv()/sendmsg()/sendfile()
+ * itself, but submits the operations through io_uring and handles their completions:
+ *
+ *  - data is received directly into state's receive buffer, completion is reported
+ *    as EPOLLIN event and parsed by the usual receive path;
+ *  - memory parts of queued requests are sent with IORING_OP_SENDMSG;
+ *  - file parts are read into buffers registered with the ring (IORING_OP_READ_FIXED)
+ *    and sent from there, sendfile() is used only when all buffers are busy.
+ *
+ * Operations queued by network thread are batched and submitted together with the next
+ * wait, so serving a batch of states costs a single io_uring_enter() call.
+ * Kernels which do not support these operations get one-shot poll requests
+ * and the synchronous IO of the epoll engine.
+ *
+ * Every in-flight request holds a reference to its state, which is either
+ * passed to the harvested event or dropped when request completes unwanted.
+ * State buffers are freed only when the last reference is dropped,
+ * so they remain valid while the kernel uses them.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+#include "elliptics/interface.h"
+
+#ifdef HAVE_IO_URING_SUPPORT
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+
+#define DNET_URING_ENTRIES		4096
+
+/* registered buffers which file parts of replies are read into */
+#define DNET_URING_FILE_BUF_NUM		16
+#define DNET_URING_FILE_BUF_SIZE	(128 * 1024)
+
+/* user_data values which do not correspond to states */
+#define DNET_URING_TAG_TIMEOUT		1ULL
+#define DNET_URING_TAG_REMOVE		2ULL
+
+/* receive request which only reports data already sitting in receive buffer */
+#define DNET_URING_NOP			(1<<2)
+
+#define DNET_URING_MASK			(DNET_URING_RECV | DNET_URING_SEND | DNET_URING_NOP)
+
+#define dnet_uring_load_acquire(p) ({ unsigned __v = *(volatile unsigned *)(p); __sync_synchronize(); __v; })
+#define dnet_uring_store_release(p, v) do { __sync_synchronize(); *(volatile unsigned *)(p) = (v); } while (0)
+
+struct dnet_uring {
+	int			fd;
+
+	pthread_mutex_t		lock;
+	pthread_t		tid;
+	int			tid_set;
+
+	/* recv/sendmsg/read requests are supported, poll requests are used otherwise */
+	int			async;
+
+	/* number of requests in flight */
+	int			armed;
+	/*
+	 * Number of queued, but not yet submitted entries. Kernel may take only some of them
+	 * (or none, if completion queue is overflown), the rest are submitted by the next call.
+	 */
+	unsigned int		pending;
+	int			timeout_armed;
+	struct __kernel_timespec	timeout;
+
+	unsigned int		sq_entries;
+	unsigned int		*sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe	*sqes;
+
+	unsigned int		*cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe	*cqes;
+
+	void			*sq_ptr, *cq_ptr;
+	size_t			sq_size, cq_size, sqes_size;
+
+	/* registered file buffers, indexes of free ones are kept in @file_free */
+	void			*file_buf;
+	int			file_free[DNET_URING_FILE_BUF_NUM];
+	int			file_free_num;
+};
+
+static int dnet_uring_enter(struct dnet_uring *u, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	int err;
+
+	err = syscall(__NR_io_uring_enter, u->fd, to_submit, min_complete, flags, NULL, 0);
+	if (err < 0)
+		return -errno;
+
+	return err;
+}
+
+static int dnet_uring_register(struct dnet_uring *u, unsigned int opcode, void *arg, unsigned int num)
+{
+	int err;
+
+	err = syscall(__NR_io_uring_register, u->fd, opcode, arg, num);
+	if (err < 0)
+		return -errno;
+
+	return err;
+}
+
+/* must be called with @u->lock held */
+static int dnet_uring_submit_nolock(struct dnet_uring *u)
+{
+	int err = 0;
+
+	if (u->pending) {
+		err = dnet_uring_enter(u, u->pending, 0, 0);
+		if (err > 0)
+			u->pending -= err;
+	}
+
+	return err;
+}
+
+/*
+ * Returns next free submission entry, it becomes visible to the kernel after dnet_uring_commit().
+ * Must be called with @u->lock held.
+ */
+static struct io_uring_sqe *dnet_uring_get_sqe(struct dnet_uring *u)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head, tail, idx;
+
+	tail = *u->sq_tail;
+	head = dnet_uring_load_acquire(u->sq_head);
+
+	if (tail - head >= u->sq_entries) {
+		dnet_uring_submit_nolock(u);
+
+		head = dnet_uring_load_acquire(u->sq_head);
+		if (tail - head >= u->sq_entries)
+			return NULL;
+	}
+
+	idx = tail & *u->sq_mask;
+	sqe = &u->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	u->sq_array[idx] = idx;
+
+	return sqe;
+}
+
+static void dnet_uring_commit(struct dnet_uring *u)
+{
+	dnet_uring_store_release(u->sq_tail, *u->sq_tail + 1);
+	u->pending++;
+}
+
+/*
+ * Entries queued by network thread itself are submitted with its next wait,
+ * other threads have to submit them immediately, since network thread may sleep.
+ */
+static void dnet_uring_flush_nolock(struct dnet_uring *u)
+{
+	if (!u->tid_set || !pthread_equal(u->tid, pthread_self()))
+		dnet_uring_submit_nolock(u);
+}
+
+/*
+ * Data is received by io_uring only for connections served by dnet_state_net_process()
+ * with receive buffer enabled, listening sockets are polled.
+ */
+static inline int __dnet_uring_recv_async(struct dnet_uring *u, struct dnet_net_state *st)
+{
+	return u->async && st->n->recv_buffer_size && st->process == dnet_state_net_process;
+}
+
+int dnet_uring_recv_async(struct dnet_net_state *st)
+{
+	return __dnet_uring_recv_async(st->uring, st);
+}
+
+int dnet_uring_send_async(struct dnet_net_state *st)
+{
+	return st->uring && st->uring->async && st->process == dnet_state_net_process;
+}
+
+/*
+ * Returns submission entry for request of @bit on behalf of @st,
+ * caller passes its state reference to the request.
+ * Must be called with @u->lock held.
+ */
+static struct io_uring_sqe *dnet_uring_state_sqe(struct dnet_uring *u, struct dnet_net_state *st, int bit)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = dnet_uring_get_sqe(u);
+	if (!sqe)
+		return NULL;
+
+	sqe->user_data = (unsigned long)st | bit;
+
+	st->uring_armed |= bit;
+	u->armed++;
+
+	return sqe;
+}
+
+/*
+ * Arms request for @bit: poll for writability for SEND, receive into empty receive buffer
+ * or poll for readability for RECV. If receive buffer still holds data, no-op request
+ * is armed instead, which reports it once completed.
+ * Caller passes its state reference to the request. Must be called with @u->lock held.
+ */
+static int __dnet_uring_arm(struct dnet_uring *u, struct dnet_net_state *st, int bit)
+{
+	struct io_uring_sqe *sqe;
+	int err;
+
+	if (bit == DNET_URING_RECV && __dnet_uring_recv_async(u, st)) {
+		err = dnet_state_rcv_buf_alloc(st);
+		if (err)
+			return err;
+
+		if (st->rcv_buf_start != st->rcv_buf_end) {
+			sqe = dnet_uring_state_sqe(u, st, bit | DNET_URING_NOP);
+			if (!sqe)
+				return -ENOSPC;
+
+			sqe->opcode = IORING_OP_NOP;
+			sqe->fd = -1;
+		} else {
+			sqe = dnet_uring_state_sqe(u, st, bit);
+			if (!sqe)
+				return -ENOSPC;
+
+			st->rcv_buf_start = st->rcv_buf_end = 0;
+
+			sqe->opcode = IORING_OP_RECV;
+			sqe->fd = st->read_s;
+			sqe->addr = (unsigned long)st->rcv_buf;
+			sqe->len = st->rcv_buf_size;
+		}
+	} else {
+		sqe = dnet_uring_state_sqe(u, st, bit);
+		if (!sqe)
+			return -ENOSPC;
+
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = (bit == DNET_URING_SEND) ? st->write_s : st->read_s;
+		sqe->poll32_events = (bit == DNET_URING_SEND) ? POLLOUT : POLLIN;
+	}
+
+	dnet_uring_commit(u);
+	return 0;
+}
+
+static int dnet_uring_arm_nolock(struct dnet_uring *u, struct dnet_net_state *st, int bit)
+{
+	int err;
+
+	dnet_state_get(st);
+
+	err = __dnet_uring_arm(u, st, bit);
+	if (err) {
+		dnet_log(st->n, DNET_LOG_ERROR, "%s: failed to arm %s request: %d\n",
+				dnet_state_dump_addr(st), (bit == DNET_URING_SEND) ? "SEND" : "RECV", err);
+		dnet_state_put(st);
+	}
+
+	return err;
+}
+
+/*
+ * Send operation in flight is re-armed by dnet_send_list() once its completion is consumed.
+ */
+int dnet_uring_schedule(struct dnet_net_state *st, int bit)
+{
+	struct dnet_uring *u = st->uring;
+	int err = 0;
+
+	pthread_mutex_lock(&u->lock);
+	st->uring_want |= bit;
+	if (!(st->uring_armed & bit) && !((bit == DNET_URING_SEND) && st->uring_send.op)) {
+		err = dnet_uring_arm_nolock(u, st, bit);
+		if (!err)
+			dnet_uring_flush_nolock(u);
+	}
+	pthread_mutex_unlock(&u->lock);
+
+	return err;
+}
+
+void dnet_uring_unschedule(struct dnet_net_state *st, int bit)
+{
+	struct dnet_uring *u = st->uring;
+	struct io_uring_sqe *sqe;
+
+	pthread_mutex_lock(&u->lock);
+	st->uring_want &= ~bit;
+	if (st->uring_armed & bit) {
+		sqe = dnet_uring_get_sqe(u);
+		if (sqe) {
+			sqe->opcode = u->async ? IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = (unsigned long)st | bit;
+			sqe->user_data = DNET_URING_TAG_REMOVE;
+
+			dnet_uring_commit(u);
+			dnet_uring_flush_nolock(u);
+		}
+	}
+	pthread_mutex_unlock(&u->lock);
+}
+
+/*
+ * Re-arms requests which completed, but are still wanted.
+ * Called by network thread after the state has been processed.
+ */
+void dnet_uring_rearm(struct dnet_net_state *st)
+{
+	struct dnet_uring *u = st->uring;
+	int bits, bit;
+
+	if (!u)
+		return;
+
+	pthread_mutex_lock(&u->lock);
+	bits = st->uring_want & ~st->uring_armed;
+	if (st->uring_send.op)
+		bits &= ~DNET_URING_SEND;
+
+	for (bit = DNET_URING_RECV; bit <= DNET_URING_SEND; bit <<= 1) {
+		if (bits & bit)
+			dnet_uring_arm_nolock(u, st, bit);
+	}
+	pthread_mutex_unlock(&u->lock);
+}
+
+/*
+ * Queues send operation @op of network thread which owns @st,
+ * completion is consumed by dnet_uring_send_result().
+ * Must be called with @u->lock held.
+ */
+static struct io_uring_sqe *dnet_uring_send_sqe(struct dnet_uring *u, struct dnet_net_state *st, int op)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = dnet_uring_state_sqe(u, st, DNET_URING_SEND);
+	if (!sqe)
+		return NULL;
+
+	dnet_state_get(st);
+	st->uring_send.op = op;
+	st->uring_send.done = 0;
+
+	return sqe;
+}
+
+/*
+ * Sends first @iov_num entries of @st->uring_send.iov, which hold memory parts of @req_num requests.
+ */
+int dnet_uring_sendmsg(struct dnet_net_state *st, int req_num, int iov_num, int flags)
+{
+	struct dnet_uring *u = st->uring;
+	struct dnet_uring_send *us = &st->uring_send;
+	struct io_uring_sqe *sqe;
+	int err = -ENOSPC;
+
+	memset(&us->msg, 0, sizeof(struct msghdr));
+	us->msg.msg_iov = us->iov;
+	us->msg.msg_iovlen = iov_num;
+	us->req_num = req_num;
+
+	pthread_mutex_lock(&u->lock);
+	sqe = dnet_uring_send_sqe(u, st, DNET_URING_SEND_MSG);
+	if (sqe) {
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = st->write_s;
+		sqe->addr = (unsigned long)&us->msg;
+		sqe->len = 1;
+		sqe->msg_flags = flags;
+
+		dnet_uring_commit(u);
+		err = 0;
+	}
+	pthread_mutex_unlock(&u->lock);
+
+	return err;
+}
+
+/*
+ * Reads up to @size bytes of file part into registered buffer of the state,
+ * returns -ENOBUFS if there is no free one, caller sends the file itself then.
+ */
+int dnet_uring_file_read(struct dnet_net_state *st, int fd, uint64_t offset, uint64_t size)
+{
+	struct dnet_uring *u = st->uring;
+	struct dnet_uring_send *us = &st->uring_send;
+	struct io_uring_sqe *sqe;
+	int err = -ENOBUFS;
+
+	if (size > DNET_URING_FILE_BUF_SIZE)
+		size = DNET_URING_FILE_BUF_SIZE;
+
+	pthread_mutex_lock(&u->lock);
+	if (us->buf < 0) {
+		if (!u->file_free_num)
+			goto err_out_unlock;
+
+		us->buf = u->file_free[--u->file_free_num];
+	}
+
+	err = -ENOSPC;
+	sqe = dnet_uring_send_sqe(u, st, DNET_URING_SEND_FILE_READ);
+	if (!sqe)
+		goto err_out_unlock;
+
+	us->buf_offset = us->buf_size = 0;
+
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->addr = (unsigned long)(u->file_buf + us->buf * DNET_URING_FILE_BUF_SIZE);
+	sqe->len = size;
+	sqe->buf_index = us->buf;
+
+	dnet_uring_commit(u);
+	err = 0;
+
+err_out_unlock:
+	pthread_mutex_unlock(&u->lock);
+	return err;
+}
+
+/*
+ * Sends part of registered buffer which was read, but not yet sent.
+ */
+int dnet_uring_file_send(struct dnet_net_state *st, int flags)
+{
+	struct dnet_uring *u = st->uring;
+	struct dnet_uring_send *us = &st->uring_send;
+	struct io_uring_sqe *sqe;
+	int err = -ENOSPC;
+
+	pthread_mutex_lock(&u->lock);
+	sqe = dnet_uring_send_sqe(u, st, DNET_URING_SEND_FILE);
+	if (sqe) {
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = st->write_s;
+		sqe->addr = (unsigned long)(u->file_buf + us->buf * DNET_URING_FILE_BUF_SIZE + us->buf_offset);
+		sqe->len = us->buf_size - us->buf_offset;
+		sqe->msg_flags = flags;
+
+		dnet_uring_commit(u);
+		err = 0;
+	}
+	pthread_mutex_unlock(&u->lock);
+
+	return err;
+}
+
+static void dnet_uring_file_release_nolock(struct dnet_uring *u, struct dnet_net_state *st)
+{
+	struct dnet_uring_send *us = &st->uring_send;
+
+	if (us->buf >= 0) {
+		u->file_free[u->file_free_num++] = us->buf;
+		us->buf = -1;
+		us->buf_offset = us->buf_size = 0;
+	}
+}
+
+void dnet_uring_file_release(struct dnet_net_state *st)
+{
+	struct dnet_uring *u = st->uring;
+
+	pthread_mutex_lock(&u->lock);
+	dnet_uring_file_release_nolock(u, st);
+	pthread_mutex_unlock(&u->lock);
+}
+
+/*
+ * Returns 1 and stores result in @res if send operation @st->uring_send.op has completed,
+ * -EINPROGRESS if it is still in flight and 0 if there is none. Completed operation stays
+ * in @st->uring_send.op until the next one is submitted or dnet_uring_send_idle() is called,
+ * so that no poll request is armed meanwhile.
+ */
+int dnet_uring_send_result(struct dnet_net_state *st, int *res)
+{
+	struct dnet_uring *u = st->uring;
+	struct dnet_uring_send *us = &st->uring_send;
+	int err = 0;
+
+	pthread_mutex_lock(&u->lock);
+	if (us->done) {
+		*res = us->res;
+		us->done = 0;
+		err = 1;
+	} else if (us->op != DNET_URING_SEND_NONE) {
+		err = -EINPROGRESS;
+	}
+	pthread_mutex_unlock(&u->lock);
+
+	return err;
+}
+
+/*
+ * Called by network thread when it stops sending without submitting another operation.
+ */
+void dnet_uring_send_idle(struct dnet_net_state *st)
+{
+	struct dnet_uring *u = st->uring;
+
+	pthread_mutex_lock(&u->lock);
+	st->uring_send.op = DNET_URING_SEND_NONE;
+	pthread_mutex_unlock(&u->lock);
+}
+
+static uint32_t dnet_uring_epoll_events(int mask)
+{
+	uint32_t events = 0;
+
+	if (mask & POLLIN)
+		events |= EPOLLIN;
+	if (mask & POLLOUT)
+		events |= EPOLLOUT;
+	if (mask & POLLERR)
+		events |= EPOLLERR;
+	if (mask & POLLHUP)
+		events |= EPOLLHUP;
+
+	return events;
+}
+
+/*
+ * Converts completion of the receive request into event, returns 0 if request has to be re-armed.
+ * Received data is accounted even if state does not want it anymore, it is parsed when
+ * reading is scheduled again. Must be called with @u->lock held.
+ */
+static uint32_t dnet_uring_recv_events(struct dnet_net_state *st, int res)
+{
+	if (res > 0) {
+		st->rcv_buf_end += res;
+		st->io_bytes += res;
+		return EPOLLIN;
+	}
+
+	if (res == 0) {
+		dnet_log(st->n, DNET_LOG_ERROR, "Peer %s has disconnected.\n",
+			dnet_server_convert_dnet_addr(&st->addr));
+		return EPOLLHUP;
+	}
+
+	if (res == -EAGAIN || res == -EINTR || res == -ECANCELED || res == -ENOBUFS)
+		return 0;
+
+	dnet_log(st->n, DNET_LOG_ERROR, "%s: failed to receive data: %d\n", dnet_state_dump_addr(st), res);
+	return EPOLLERR;
+}
+
+/*
+ * Moves completed requests into @nio->events, every returned event holds
+ * a reference to its state. Completed send operations are stored in the state,
+ * requests which were unscheduled meanwhile are dropped, failed poll and receive
+ * requests which are still wanted are re-armed.
+ */
+static int dnet_uring_harvest(struct dnet_net_io *nio, int carry)
+{
+	struct dnet_uring *u = nio->uring;
+	struct io_uring_cqe *cqe;
+	struct dnet_net_state *st;
+	struct epoll_event *ev;
+	unsigned int head, tail;
+	uint64_t data;
+	uint32_t events;
+	int num = carry, bit, res, received;
+
+	head = *u->cq_head;
+	tail = dnet_uring_load_acquire(u->cq_tail);
+
+	while (head != tail && num < nio->event_num) {
+		cqe = &u->cqes[head & *u->cq_mask];
+		data = cqe->user_data;
+		res = cqe->res;
+		head++;
+
+		if (data == DNET_URING_TAG_TIMEOUT) {
+			u->timeout_armed = 0;
+			continue;
+		}
+
+		if (data == DNET_URING_TAG_REMOVE)
+			continue;
+
+		st = (struct dnet_net_state *)(unsigned long)(data & ~(uint64_t)DNET_URING_MASK);
+		bit = data & (DNET_URING_RECV | DNET_URING_SEND);
+		received = 0;
+
+		pthread_mutex_lock(&u->lock);
+		st->uring_armed &= ~bit;
+		u->armed--;
+
+		if (bit == DNET_URING_SEND && st->uring_send.op && !st->uring_send.done) {
+			st->uring_send.res = res;
+			st->uring_send.done = 1;
+			events = EPOLLOUT;
+
+			/* registered buffer can not be released while kernel uses it */
+			if (!(st->uring_want & bit)) {
+				st->uring_send.op = DNET_URING_SEND_NONE;
+				st->uring_send.done = 0;
+				dnet_uring_file_release_nolock(u, st);
+			}
+		} else if (data & DNET_URING_NOP) {
+			events = EPOLLIN;
+		} else if (bit == DNET_URING_RECV && __dnet_uring_recv_async(u, st)) {
+			events = dnet_uring_recv_events(st, res);
+			if (res > 0)
+				received = res;
+		} else {
+			events = (res < 0) ? 0 : dnet_uring_epoll_events(res);
+		}
+
+		if (!(st->uring_want & bit)) {
+			pthread_mutex_unlock(&u->lock);
+			dnet_state_put(st);
+			continue;
+		}
+
+		if (!events) {
+			if (__dnet_uring_arm(u, st, bit)) {
+				pthread_mutex_unlock(&u->lock);
+				dnet_state_put(st);
+			} else {
+				pthread_mutex_unlock(&u->lock);
+			}
+			continue;
+		}
+		pthread_mutex_unlock(&u->lock);
+
+		ev = &nio->events[num];
+		ev->events = events;
+		ev->data.ptr = st;
+
+		/* data received by io_uring is charged here, since processing does not read socket */
+		nio->budget[num] = DNET_DEFAULT_NET_STATE_BUDGET - received;
+		num++;
+	}
+
+	dnet_uring_store_release(u->cq_head, head);
+
+	return num - carry;
+}
+
+/*
+ * Submits everything queued so far and waits for at least one completion,
+ * or for the periodic timeout, which lets network thread check for exit and stalled states.
+ * Completed events are placed after @carry events already pending in @nio->events,
+ * and if there are such events, it does not wait at all.
+ */
+int dnet_uring_wait(struct dnet_net_io *nio, int carry)
+{
+	struct dnet_uring *u = nio->uring;
+	struct io_uring_sqe *sqe;
+	unsigned int to_submit;
+	int err;
+
+	pthread_mutex_lock(&u->lock);
+	if (!u->tid_set) {
+		u->tid = pthread_self();
+		u->tid_set = 1;
+	}
+
+	if (!u->timeout_armed) {
+		sqe = dnet_uring_get_sqe(u);
+		if (sqe) {
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->fd = -1;
+			sqe->addr = (unsigned long)&u->timeout;
+			sqe->len = 1;
+			sqe->user_data = DNET_URING_TAG_TIMEOUT;
+
+			dnet_uring_commit(u);
+			u->timeout_armed = 1;
+		}
+	}
+
+	to_submit = u->pending;
+	pthread_mutex_unlock(&u->lock);
+
+	err = dnet_uring_enter(u, to_submit, carry ? 0 : 1, IORING_ENTER_GETEVENTS);
+	if (err > 0) {
+		pthread_mutex_lock(&u->lock);
+		u->pending -= err;
+		pthread_mutex_unlock(&u->lock);
+	}
+	if (err < 0 && err != -EINTR && err != -EAGAIN && err != -EBUSY)
+		return err;
+
+	return dnet_uring_harvest(nio, carry);
+}
+
+/*
+ * Returns non-zero if kernel supports every operation used for asynchronous IO.
+ */
+static int dnet_uring_probe(struct dnet_uring *u)
+{
+	static const int ops[] = {IORING_OP_NOP, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SENDMSG,
+		IORING_OP_READ_FIXED, IORING_OP_ASYNC_CANCEL};
+	struct io_uring_probe *p;
+	size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	unsigned int i;
+	int async = 0;
+
+	p = malloc(size);
+	if (!p)
+		goto err_out_exit;
+	memset(p, 0, size);
+
+	if (dnet_uring_register(u, IORING_REGISTER_PROBE, p, IORING_OP_LAST) < 0)
+		goto err_out_free;
+
+	for (i = 0; i < ARRAY_SIZE(ops); ++i) {
+		if (ops[i] > p->last_op || !(p->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+			goto err_out_free;
+	}
+
+	async = 1;
+
+err_out_free:
+	free(p);
+err_out_exit:
+	return async;
+}
+
+/*
+ * Registers file buffers with the ring, so that file reads do not map pages every time.
+ * Without them file parts are sent with sendfile().
+ */
+static int dnet_uring_file_init(struct dnet_uring *u)
+{
+	struct iovec iov[DNET_URING_FILE_BUF_NUM];
+	void *buf;
+	int i, err;
+
+	buf = mmap(NULL, DNET_URING_FILE_BUF_NUM * DNET_URING_FILE_BUF_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		err = -errno;
+		goto err_out_exit;
+	}
+
+	for (i = 0; i < DNET_URING_FILE_BUF_NUM; ++i) {
+		iov[i].iov_base = buf + i * DNET_URING_FILE_BUF_SIZE;
+		iov[i].iov_len = DNET_URING_FILE_BUF_SIZE;
+
+		u->file_free[i] = DNET_URING_FILE_BUF_NUM - i - 1;
+	}
+
+	err = dnet_uring_register(u, IORING_REGISTER_BUFFERS, iov, DNET_URING_FILE_BUF_NUM);
+	if (err < 0)
+		goto err_out_unmap;
+
+	u->file_buf = buf;
+	u->file_free_num = DNET_URING_FILE_BUF_NUM;
+	return 0;
+
+err_out_unmap:
+	munmap(buf, DNET_URING_FILE_BUF_NUM * DNET_URING_FILE_BUF_SIZE);
+err_out_exit:
+	return err;
+}
+
+int dnet_uring_init(struct dnet_net_io *nio)
+{
+	struct io_uring_params p;
+	struct dnet_uring *u;
+	int err;
+
+	u = malloc(sizeof(struct dnet_uring));
+	if (!u) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(u, 0, sizeof(struct dnet_uring));
+
+	u->timeout.tv_sec = 1;
+
+	err = pthread_mutex_init(&u->lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_free;
+	}
+
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, DNET_URING_ENTRIES, &p);
+	if (u->fd < 0) {
+		err = -errno;
+		goto err_out_destroy;
+	}
+
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED) {
+		err = -errno;
+		goto err_out_close;
+	}
+
+	u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+	if (u->cq_ptr == MAP_FAILED) {
+		err = -errno;
+		goto err_out_unmap_sq;
+	}
+
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		err = -errno;
+		goto err_out_unmap_cq;
+	}
+
+	u->sq_entries = p.sq_entries;
+	u->sq_head = u->sq_ptr + p.sq_off.head;
+	u->sq_tail = u->sq_ptr + p.sq_off.tail;
+	u->sq_mask = u->sq_ptr + p.sq_off.ring_mask;
+	u->sq_array = u->sq_ptr + p.sq_off.array;
+
+	u->cq_head = u->cq_ptr + p.cq_off.head;
+	u->cq_tail = u->cq_ptr + p.cq_off.tail;
+	u->cq_mask = u->cq_ptr + p.cq_off.ring_mask;
+	u->cqes = u->cq_ptr + p.cq_off.cqes;
+
+	u->async = dnet_uring_probe(u);
+	if (u->async) {
+		err = dnet_uring_file_init(u);
+		if (err)
+			dnet_log(nio->n, DNET_LOG_NOTICE, "io_uring: could not register file buffers, "
+					"file parts will be sent with sendfile(): %d\n", err);
+	} else {
+		dnet_log(nio->n, DNET_LOG_NOTICE, "io_uring: asynchronous IO is not supported, using poll requests\n");
+	}
+
+	nio->uring = u;
+	return 0;
+
+err_out_unmap_cq:
+	munmap(u->cq_ptr, u->cq_size);
+err_out_unmap_sq:
+	munmap(u->sq_ptr, u->sq_size);
+err_out_close:
+	close(u->fd);
+err_out_destroy:
+	pthread_mutex_destroy(&u->lock);
+err_out_free:
+	free(u);
+err_out_exit:
+	return err;
+}
+
+/*
+ * Called after network thread has been stopped and states have been reset:
+ * waits for cancelled requests to complete to drop their state references.
+ */
+void dnet_uring_exit(struct dnet_net_io *nio)
+{
+	struct dnet_uring *u = nio->uring;
+	int i, num, timeouts = 0;
+
+	if (!u)
+		return;
+
+	while (u->armed > 0 && timeouts < 2) {
+		if (!u->timeout_armed)
+			timeouts++;
+
+		num = dnet_uring_wait(nio, 0);
+		if (num < 0)
+			break;
+
+		for (i = 0; i < num; ++i)
+			dnet_state_put(nio->events[i].data.ptr);
+	}
+
+	munmap(u->sqes, u->sqes_size);
+	munmap(u->cq_ptr, u->cq_size);
+	munmap(u->sq_ptr, u->sq_size);
+	close(u->fd);
+
+	if (u->file_buf)
+		munmap(u->file_buf, DNET_URING_FILE_BUF_NUM * DNET_URING_FILE_BUF_SIZE);
+
+	pthread_mutex_destroy(&u->lock);
+	free(u);
+
+	nio->uring = NULL;
+}
+
+#else
+
+int dnet_uring_init(struct dnet_net_io *nio __unused)
+{
+	return -ENOTSUP;
+}
+
+void dnet_uring_exit(struct dnet_net_io *nio __unused)
+{
+}
+
+int dnet_uring_wait(struct dnet_net_io *nio __unused, int carry __unused)
+{
+	return -ENOTSUP;
+}
+
+int dnet_uring_schedule(struct dnet_net_state *st __unused, int bit __unused)
+{
+	return -ENOTSUP;
+}
+
+void dnet_uring_unschedule(struct dnet_net_state *st __unused, int bit __unused)
+{
+}
+
+void dnet_uring_rearm(struct dnet_net_state *st __unused)
+{
+}
+
+int dnet_uring_recv_async(struct dnet_net_state *st __unused)
+{
+	return 0;
+}
+
+int dnet_uring_send_async(struct dnet_net_state *st __unused)
+{
+	return 0;
+}
+
+int dnet_uring_send_result(struct dnet_net_state *st __unused, int *res __unused)
+{
+	return 0;
+}
+
+void dnet_uring_send_idle(struct dnet_net_state *st __unused)
+{
+}
+
+int dnet_uring_sendmsg(struct dnet_net_state *st __unused, int req_num __unused,
+		int iov_num __unused, int flags __unused)
+{
+	return -ENOTSUP;
+}
+
+int dnet_uring_file_read(struct dnet_net_state *st __unused, int fd __unused,
+		uint64_t offset __unused, uint64_t size __unused)
+{
+	return -ENOBUFS;
+}
+
+int dnet_uring_file_send(struct dnet_net_state *st __unused, int flags __unused)
+{
+	return -ENOTSUP;
+}
+
+void dnet_uring_file_release(struct dnet_net_state *st __unused)
+{
+}
+
+#endif
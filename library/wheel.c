@@ -0,0 +1,134 @@
+/*
+ * 2012+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "wheel.h"
+
+#define DNET_WHEEL_RANGE	(1ULL << (DNET_WHEEL_BITS * DNET_WHEEL_LEVELS))
+
+void dnet_wheel_init(struct dnet_wheel *w, uint64_t now)
+{
+	int level, i;
+
+	w->now = now;
+
+	for (level = 0; level < DNET_WHEEL_LEVELS; ++level)
+		for (i = 0; i < DNET_WHEEL_SIZE; ++i)
+			INIT_LIST_HEAD(&w->slots[level][i]);
+}
+
+static void __dnet_wheel_add(struct dnet_wheel *w, struct dnet_wheel_timer *timer)
+{
+	uint64_t expires = timer->expires, delta;
+	int level, idx;
+
+	if (expires < w->now)
+		expires = w->now;
+
+	delta = expires - w->now;
+	if (delta >= DNET_WHEEL_RANGE) {
+		delta = DNET_WHEEL_RANGE - 1;
+		expires = w->now + delta;
+	}
+
+	for (level = 0; level < DNET_WHEEL_LEVELS - 1; ++level) {
+		if (delta < (1ULL << (DNET_WHEEL_BITS * (level + 1))))
+			break;
+	}
+
+	idx = (expires >> (DNET_WHEEL_BITS * level)) & DNET_WHEEL_MASK;
+	list_add_tail(&timer->entry, &w->slots[level][idx]);
+}
+
+void dnet_wheel_add(struct dnet_wheel *w, struct dnet_wheel_timer *timer, uint64_t expires)
+{
+	list_del_init(&timer->entry);
+
+	timer->expires = expires;
+	__dnet_wheel_add(w, timer);
+}
+
+/*
+ * Re-distributes timers of given upper level slot among lower levels,
+ * returns slot index, cascading goes further up only when it is zero.
+ */
+static int dnet_wheel_cascade(struct dnet_wheel *w, int level)
+{
+	struct dnet_wheel_timer *timer, *tmp;
+	struct list_head head;
+	int idx = (w->now >> (DNET_WHEEL_BITS * level)) & DNET_WHEEL_MASK;
+
+	INIT_LIST_HEAD(&head);
+	list_splice_init(&w->slots[level][idx], &head);
+
+	list_for_each_entry_safe(timer, tmp, &head, entry) {
+		list_del(&timer->entry);
+		__dnet_wheel_add(w, timer);
+	}
+
+	return idx;
+}
+
+static int dnet_wheel_empty(struct dnet_wheel *w)
+{
+	int level, i;
+
+	for (level = 0; level < DNET_WHEEL_LEVELS; ++level)
+		for (i = 0; i < DNET_WHEEL_SIZE; ++i)
+			if (!list_empty(&w->slots[level][i]))
+				return 0;
+
+	return 1;
+}
+
+/*
+ * Moves timers which expire at or before @now into @expired list,
+ * returns number of moved timers.
+ */
+int dnet_wheel_advance(struct dnet_wheel *w, uint64_t now, struct list_head *expired)
+{
+	struct list_head *slot, *pos;
+	int level, num = 0;
+
+	if (now < w->now)
+		return 0;
+
+	if (now - w->now > DNET_WHEEL_SIZE && dnet_wheel_empty(w)) {
+		w->now = now + 1;
+		return 0;
+	}
+
+	while (w->now <= now) {
+		int idx = w->now & DNET_WHEEL_MASK;
+
+		if (!idx) {
+			for (level = 1; level < DNET_WHEEL_LEVELS; ++level) {
+				if (dnet_wheel_cascade(w, level))
+					break;
+			}
+		}
+
+		slot = &w->slots[0][idx];
+		if (!list_empty(slot)) {
+			list_for_each(pos, slot)
+				num++;
+
+			list_splice_init(slot, expired->prev);
+		}
+
+		w->now++;
+	}
+
+	return num;
+}
@@ -0,0 +1,82 @@
+/*
+ * 2012+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __DNET_WHEEL_H
+#define __DNET_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "list.h"
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * Timers are kept in per-level arrays of lists, level 0 slot covers single tick,
+ * every next level slot covers whole previous level. Insertion and removal are O(1),
+ * advancing the wheel moves every expired timer into caller's list,
+ * timers from upper levels are cascaded down when lower level wraps.
+ *
+ * Wheel does no locking, caller serializes access.
+ */
+
+#define DNET_WHEEL_BITS		6
+#define DNET_WHEEL_SIZE		(1 << DNET_WHEEL_BITS)
+#define DNET_WHEEL_MASK		(DNET_WHEEL_SIZE - 1)
+#define DNET_WHEEL_LEVELS	4
+
+/* wheel tick in milliseconds */
+#define DNET_WHEEL_TICK_MS	100
+
+struct dnet_wheel_timer {
+	struct list_head	entry;
+	uint64_t		expires;
+};
+
+struct dnet_wheel {
+	/* all timers which expire before this tick have been collected */
+	uint64_t		now;
+	struct list_head	slots[DNET_WHEEL_LEVELS][DNET_WHEEL_SIZE];
+};
+
+static inline uint64_t dnet_wheel_ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / DNET_WHEEL_TICK_MS;
+}
+
+static inline void dnet_wheel_timer_init(struct dnet_wheel_timer *timer)
+{
+	INIT_LIST_HEAD(&timer->entry);
+	timer->expires = 0;
+}
+
+/*
+ * Timer may be linked either into the wheel or into expired list,
+ * removal is the same in both cases.
+ */
+static inline void dnet_wheel_del(struct dnet_wheel_timer *timer)
+{
+	list_del_init(&timer->entry);
+}
+
+void dnet_wheel_init(struct dnet_wheel *w, uint64_t now);
+void dnet_wheel_add(struct dnet_wheel *w, struct dnet_wheel_timer *timer, uint64_t expires);
+int dnet_wheel_advance(struct dnet_wheel *w, uint64_t now, struct list_head *expired);
+
+#endif /* __DNET_WHEEL_H */